@@ -0,0 +1,81 @@
+// bench_common.h
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Read the monotonic clock in nanoseconds.
+ */
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Small xorshift64* generator.
+ *
+ * Every benchmark seeds its own generator so that the memory manager and the
+ * glibc baseline replay exactly the same sequence of requests.
+ */
+typedef struct {
+    uint64_t state;
+} BenchRng;
+
+static inline void bench_rng_seed(BenchRng* rng, uint64_t seed) {
+    rng->state = seed ? seed : 0x9E3779B97F4A7C15ull;
+}
+
+static inline uint64_t bench_rng_next(BenchRng* rng) {
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/** Uniform integer in [lo, hi] (inclusive). */
+static inline size_t bench_rng_range(BenchRng* rng, size_t lo, size_t hi) {
+    return lo + (size_t)(bench_rng_next(rng) % (hi - lo + 1));
+}
+
+/** Uniform double in [0, 1). */
+static inline double bench_rng_unit(BenchRng* rng) {
+    return (double)(bench_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Open a JSON results file and write the common header fields.
+ *
+ * The caller appends its own "results" array and closes the document with
+ * bench_json_close().
+ *
+ * @return The open file, or NULL if it could not be created.
+ */
+static inline FILE* bench_json_open(const char* path, const char* bench_name,
+                                    const char* date, const char* sha) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return NULL;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"%s\",\n", bench_name);
+    fprintf(out, "  \"timestamp\": %lld,\n", (long long)time(NULL));
+    fprintf(out, "  \"git_date\": \"%s\",\n", date);
+    fprintf(out, "  \"git_sha\": \"%s\",\n", sha);
+    return out;
+}
+
+static inline void bench_json_close(FILE* out) {
+    fprintf(out, "}\n");
+    fclose(out);
+}
+
+#endif // BENCH_COMMON_H
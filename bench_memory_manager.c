@@ -0,0 +1,246 @@
+#include "memory_manager.h"
+#include "memory_manager_inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench_common.h"
+
+#include "gitdata.h"
+
+/**
+ * @struct BenchAllocator
+ * @brief Allocator under test; the memory manager and glibc share this interface.
+ */
+typedef struct {
+    const char* name;
+    int (*init)(size_t pool_size);
+    void* (*alloc)(size_t size);
+    void (*release)(void* ptr);
+    void (*deinit)(void);
+} BenchAllocator;
+
+static int glibc_init(size_t pool_size) { (void)pool_size; return 0; }
+static void glibc_deinit(void) {}
+
+static int mm_eager_init(size_t pool_size) {
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    return mem_init(pool_size);
+}
+
+static int mm_deferred_init(size_t pool_size) {
+    mem_set_coalescing(MEM_COALESCE_DEFERRED, 64);
+    return mem_init(pool_size);
+}
+
+// Pool faulted in by one thread per online CPU before the timed loop
+static int mm_prefault_init(size_t pool_size) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    MemInitOptions options = { cpus > 0 ? (unsigned)cpus : 1, 0 };
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    return mem_init_ex(pool_size, &options, NULL);
+}
+
+// Requests up to 128 bytes served from a bitmap region of a quarter of the pool
+static int mm_small_init(size_t pool_size) {
+    MemSmallBlocks config = { pool_size / 4, 16, 128 };
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    mem_set_small_blocks(&config);
+    return mem_init(pool_size);
+}
+
+static void mm_small_deinit(void) {
+    mem_deinit();
+    mem_set_small_blocks(NULL);
+}
+
+// Requests up to 64 bytes served from size-segregated pages making up a quarter of the pool
+static int mm_bags_init(size_t pool_size) {
+    MemPageBags config = { pool_size / 4 / 4096, 64 };
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    mem_set_page_bags(&config);
+    return mem_init(pool_size);
+}
+
+static void mm_bags_deinit(void) {
+    mem_deinit();
+    mem_set_page_bags(NULL);
+}
+
+// Per-thread size-class caches in front of the pool (memory_manager_inline.h)
+static void* mm_inline_alloc(size_t size) { return mem_alloc_inline(size); }
+static void mm_inline_free(void* ptr) { mem_free_inline(ptr); }
+static void mm_inline_deinit(void) {
+    mem_tcache_flush();
+    mem_deinit();
+}
+
+static const BenchAllocator bench_allocators[] = {
+    { "memory_manager", mm_eager_init, mem_alloc, mem_free, mem_deinit },
+    { "mm_deferred", mm_deferred_init, mem_alloc, mem_free, mem_deinit },
+    { "mm_prefault", mm_prefault_init, mem_alloc, mem_free, mem_deinit },
+    { "mm_small", mm_small_init, mem_alloc, mem_free, mm_small_deinit },
+    { "mm_bags", mm_bags_init, mem_alloc, mem_free, mm_bags_deinit },
+    { "mm_inline", mm_eager_init, mm_inline_alloc, mm_inline_free, mm_inline_deinit },
+    { "glibc", glibc_init, malloc, free, glibc_deinit },
+};
+
+/**
+ * @struct BenchWorkload
+ * @brief A size distribution and the lifetime pattern used to drive it.
+ *
+ * @var fifo 0 frees random live slots, 1 frees in allocation order (producer-consumer).
+ */
+typedef struct {
+    const char* name;
+    size_t (*next_size)(BenchRng* rng);
+    size_t max_size;
+    int fifo;
+} BenchWorkload;
+
+static size_t size_uniform(BenchRng* rng) { return bench_rng_range(rng, 16, 4096); }
+static size_t size_pow2(BenchRng* rng) { return (size_t)1 << bench_rng_range(rng, 4, 12); }
+static size_t size_bimodal(BenchRng* rng) {
+    if (bench_rng_unit(rng) < 0.9) return bench_rng_range(rng, 16, 64);
+    return bench_rng_range(rng, 2048, 8192);
+}
+static size_t size_message(BenchRng* rng) { return bench_rng_range(rng, 64, 1024); }
+
+static const BenchWorkload bench_workloads[] = {
+    { "uniform", size_uniform, 4096, 0 },
+    { "power_of_two", size_pow2, 4096, 0 },
+    { "bimodal", size_bimodal, 8192, 0 },
+    { "producer_consumer", size_message, 1024, 1 },
+};
+
+typedef struct {
+    uint64_t elapsed_ns;
+    size_t ops;
+    size_t failed;
+} BenchResult;
+
+/**
+ * @brief Run one workload against one allocator.
+ *
+ * Every operation is either an allocation or a free. The random-slot workloads
+ * toggle a randomly chosen slot; the producer-consumer workload appends to a
+ * ring and releases from its head, so blocks die in allocation order.
+ */
+static BenchResult bench_run(const BenchAllocator* a, const BenchWorkload* w,
+                             size_t ops, size_t slots, uint64_t seed) {
+    BenchResult r = { 0, 0, 0 };
+    void** live = calloc(slots, sizeof(void*));
+    if (!live) return r;
+
+    BenchRng rng;
+    bench_rng_seed(&rng, seed);
+    if (a->init(slots * w->max_size * 2) != 0) {
+        free(live);
+        return r;
+    }
+
+    size_t head = 0, count = 0;
+    uint64_t start = bench_now_ns();
+    for (size_t op = 0; op < ops; op++) {
+        if (w->fifo) {
+            if (count == slots || (count > 0 && bench_rng_unit(&rng) < 0.5)) {
+                a->release(live[head]);
+                head = (head + 1) % slots;
+                count--;
+            } else {
+                size_t slot = (head + count) % slots;
+                live[slot] = a->alloc(w->next_size(&rng));
+                if (live[slot]) {
+                    *(volatile char*)live[slot] = (char)op;
+                    count++;
+                } else {
+                    r.failed++;
+                }
+            }
+        } else {
+            size_t slot = bench_rng_range(&rng, 0, slots - 1);
+            if (live[slot]) {
+                a->release(live[slot]);
+                live[slot] = NULL;
+            } else {
+                live[slot] = a->alloc(w->next_size(&rng));
+                if (live[slot]) *(volatile char*)live[slot] = (char)op;
+                else r.failed++;
+            }
+        }
+    }
+    r.elapsed_ns = bench_now_ns() - start;
+    r.ops = ops;
+
+    if (w->fifo) {
+        for (; count > 0; count--, head = (head + 1) % slots) a->release(live[head]);
+    } else {
+        for (size_t k = 0; k < slots; k++) if (live[k]) a->release(live[k]);
+    }
+    a->deinit();
+    free(live);
+    return r;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [-n ops] [-s live_slots] [-r repetitions] [-o results.json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = 200000;
+    size_t slots = 1024;
+    int reps = 3;
+    const char* out_path = "bench_output.json";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r:o:h")) != -1) {
+        switch (opt) {
+        case 'n': ops = strtoull(optarg, NULL, 10); break;
+        case 's': slots = strtoull(optarg, NULL, 10); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (ops == 0 || slots == 0 || reps < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("Git Version; %s/%s \n", git_date, git_sha);
+    printf("%-16s %-18s %12s %10s %8s\n", "allocator", "workload", "ops/sec", "ns/op", "failed");
+
+    FILE* json = bench_json_open(out_path, "bench_memory_manager", git_date, git_sha);
+    if (!json) return 1;
+    fprintf(json, "  \"ops\": %zu,\n  \"live_slots\": %zu,\n  \"repetitions\": %d,\n", ops, slots, reps);
+    fprintf(json, "  \"results\": [\n");
+
+    size_t n_alloc = sizeof(bench_allocators) / sizeof(bench_allocators[0]);
+    size_t n_work = sizeof(bench_workloads) / sizeof(bench_workloads[0]);
+    int first = 1;
+    for (size_t w = 0; w < n_work; w++) {
+        for (size_t a = 0; a < n_alloc; a++) {
+            // Best of N repetitions; every repetition replays the same seed.
+            BenchResult best = { 0, 0, 0 };
+            for (int k = 0; k < reps; k++) {
+                BenchResult r = bench_run(&bench_allocators[a], &bench_workloads[w], ops, slots, 42 + w);
+                if (k == 0 || r.elapsed_ns < best.elapsed_ns) best = r;
+            }
+            double secs = best.elapsed_ns / 1e9;
+            double ops_per_sec = secs > 0 ? best.ops / secs : 0;
+            double ns_per_op = best.ops ? (double)best.elapsed_ns / best.ops : 0;
+
+            printf("%-16s %-18s %12.0f %10.1f %8zu\n", bench_allocators[a].name,
+                   bench_workloads[w].name, ops_per_sec, ns_per_op, best.failed);
+            fprintf(json, "%s    {\"allocator\": \"%s\", \"workload\": \"%s\", \"ops\": %zu, "
+                    "\"seconds\": %.9f, \"ops_per_sec\": %.1f, \"ns_per_op\": %.2f, \"failed_allocs\": %zu}",
+                    first ? "" : ",\n", bench_allocators[a].name, bench_workloads[w].name,
+                    best.ops, secs, ops_per_sec, ns_per_op, best.failed);
+            first = 0;
+        }
+    }
+    fprintf(json, "\n  ]\n");
+    bench_json_close(json);
+    printf("Results written to %s\n", out_path);
+    return 0;
+}
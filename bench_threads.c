@@ -0,0 +1,340 @@
+#include "memory_manager.h"
+#include "memory_manager_inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bench_common.h"
+
+#include "gitdata.h"
+
+/**
+ * @struct ThreadAllocator
+ * @brief Allocator under test plus the synchronization it needs to be shared.
+ *
+ * The memory manager keeps a single unsynchronized block list, so it is driven
+ * through one process-wide mutex ("external_mutex"). With the maintenance
+ * thread running it serializes itself ("maintenance") and merges deferred
+ * frees off the request path. The lock-free fixed-size pool ("lock_free")
+ * serves every request from one 512-byte object class with a tagged CAS
+ * stack. The inline thread caches ("thread_cache") run in thread-safe mode;
+ * a block freed by the peer goes back to its owner's remote-free list.
+ * glibc malloc is thread-safe and called directly.
+ */
+typedef struct {
+    const char* name;
+    const char* sync;
+    int (*init)(size_t pool_size);
+    void* (*alloc)(size_t size);
+    void (*release)(void* ptr);
+    void (*deinit)(void);
+} ThreadAllocator;
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* mm_locked_alloc(size_t size) {
+    pthread_mutex_lock(&mm_lock);
+    void* ptr = mem_alloc(size);
+    pthread_mutex_unlock(&mm_lock);
+    return ptr;
+}
+
+static void mm_locked_free(void* ptr) {
+    pthread_mutex_lock(&mm_lock);
+    mem_free(ptr);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static int glibc_init(size_t pool_size) { (void)pool_size; return 0; }
+static void glibc_deinit(void) {}
+
+static int mm_eager_init(size_t pool_size) {
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    return mem_init(pool_size);
+}
+
+// Deferred frees merged inline once 64 are pending
+static int mm_deferred_init(size_t pool_size) {
+    mem_set_coalescing(MEM_COALESCE_DEFERRED, 64);
+    return mem_init(pool_size);
+}
+
+// Deferred frees merged only by the maintenance thread
+static int mm_maintained_init(size_t pool_size) {
+    MemMaintenanceConfig config = { 2, 25, 64, 8, 0 };
+    mem_set_coalescing(MEM_COALESCE_DEFERRED, 0);
+    if (mem_init(pool_size) != 0) return -1;
+    return mem_maintenance_start(&config);
+}
+
+// Fixed-size objects big enough for the largest request, half the pool's worth
+static MemFixedPool* mm_fixed;
+
+static int mm_fixed_init(size_t pool_size) {
+    if (mm_eager_init(pool_size) != 0) return -1;
+    mm_fixed = mem_fixed_create(512, pool_size / 1024);
+    return mm_fixed ? 0 : -1;
+}
+
+static void* mm_fixed_alloc(size_t size) { return size <= 512 ? mem_fixed_alloc(mm_fixed) : NULL; }
+static void mm_fixed_free(void* ptr) { mem_fixed_free(mm_fixed, ptr); }
+
+static void mm_fixed_deinit(void) {
+    mem_fixed_destroy(mm_fixed);
+    mm_fixed = NULL;
+    mem_deinit();
+}
+
+static int mm_inline_init(size_t pool_size) {
+    if (mm_eager_init(pool_size) != 0) return -1;
+    mem_set_thread_safe(1);
+    return 0;
+}
+
+static void* mm_inline_alloc(size_t size) { return mem_alloc_inline(size); }
+static void mm_inline_free(void* ptr) { mem_free_inline(ptr); }
+
+static void mm_inline_deinit(void) {
+    mem_tcache_flush();
+    mem_set_thread_safe(0);
+    mem_deinit();
+}
+
+static const ThreadAllocator thread_allocators[] = {
+    { "memory_manager", "external_mutex", mm_eager_init, mm_locked_alloc, mm_locked_free, mem_deinit },
+    { "mm_deferred", "external_mutex", mm_deferred_init, mm_locked_alloc, mm_locked_free, mem_deinit },
+    { "mm_maintained", "maintenance", mm_maintained_init, mem_alloc, mem_free, mem_deinit },
+    { "mm_inline", "thread_cache", mm_inline_init, mm_inline_alloc, mm_inline_free, mm_inline_deinit },
+    { "mm_fixed", "lock_free", mm_fixed_init, mm_fixed_alloc, mm_fixed_free, mm_fixed_deinit },
+    { "glibc", "internal", glibc_init, malloc, free, glibc_deinit },
+};
+
+#define INBOX_CAPACITY 256
+
+/**
+ * @struct Inbox
+ * @brief Bounded queue of blocks handed to a thread for a cross-thread free.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    void* items[INBOX_CAPACITY];
+    size_t head;
+    size_t count;
+} Inbox;
+
+typedef struct {
+    const ThreadAllocator* alloc;
+    int id;
+    int nthreads;
+    size_t ops;
+    size_t slots;
+    double remote_ratio;
+    Inbox* inboxes;
+    pthread_barrier_t* start;
+    uint64_t* latency;      /**< Per-operation latency samples in ns */
+    size_t samples;         /**< Number of timed allocator calls */
+    size_t remote_frees;    /**< Blocks this thread freed on behalf of another */
+    size_t failed;
+} Worker;
+
+static int inbox_push(Inbox* box, void* ptr) {
+    int ok = 0;
+    pthread_mutex_lock(&box->lock);
+    if (box->count < INBOX_CAPACITY) {
+        box->items[(box->head + box->count) % INBOX_CAPACITY] = ptr;
+        box->count++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&box->lock);
+    return ok;
+}
+
+static void* inbox_pop(Inbox* box) {
+    void* ptr = NULL;
+    pthread_mutex_lock(&box->lock);
+    if (box->count > 0) {
+        ptr = box->items[box->head];
+        box->head = (box->head + 1) % INBOX_CAPACITY;
+        box->count--;
+    }
+    pthread_mutex_unlock(&box->lock);
+    return ptr;
+}
+
+/**
+ * @brief Worker loop: mixed alloc/free with a share of frees done by a sibling.
+ *
+ * A block picked for release is either freed locally or, with probability
+ * remote_ratio, pushed to the next thread's inbox. Every iteration first
+ * drains one pending block from the thread's own inbox, so thread A allocates
+ * and thread B frees. Only allocator calls are timed.
+ */
+static void* worker_main(void* arg) {
+    Worker* w = arg;
+    const ThreadAllocator* a = w->alloc;
+    void** live = calloc(w->slots, sizeof(void*));
+    BenchRng rng;
+    bench_rng_seed(&rng, 0xC0FFEEull + (uint64_t)w->id);
+    Inbox* mine = &w->inboxes[w->id];
+    Inbox* peer = &w->inboxes[(w->id + 1) % w->nthreads];
+
+    pthread_barrier_wait(w->start);
+    for (size_t op = 0; op < w->ops; op++) {
+        void* foreign = inbox_pop(mine);
+        uint64_t t0 = bench_now_ns();
+        if (foreign) {
+            a->release(foreign);
+            w->remote_frees++;
+        } else {
+            size_t slot = bench_rng_range(&rng, 0, w->slots - 1);
+            if (live[slot]) {
+                if (w->nthreads > 1 && bench_rng_unit(&rng) < w->remote_ratio &&
+                    inbox_push(peer, live[slot])) {
+                    live[slot] = NULL;
+                    continue;
+                }
+                a->release(live[slot]);
+                live[slot] = NULL;
+            } else {
+                live[slot] = a->alloc(bench_rng_range(&rng, 16, 512));
+                if (live[slot]) *(volatile char*)live[slot] = (char)op;
+                else w->failed++;
+            }
+        }
+        w->latency[w->samples++] = bench_now_ns() - t0;
+    }
+
+    for (size_t k = 0; k < w->slots; k++) if (live[k]) a->release(live[k]);
+    free(live);
+    return NULL;
+}
+
+static int cmp_u64(const void* x, const void* y) {
+    uint64_t a = *(const uint64_t*)x, b = *(const uint64_t*)y;
+    return (a > b) - (a < b);
+}
+
+/** Percentile of an already sorted sample array. */
+static uint64_t percentile(const uint64_t* sorted, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(p * (n - 1));
+    return sorted[idx];
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [-t max_threads] [-n ops_per_thread] [-s live_slots] [-x remote_ratio] [-o results.json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = 4;
+    size_t ops = 100000;
+    size_t slots = 512;
+    double remote_ratio = 0.25;
+    const char* out_path = "bench_threads.json";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:s:x:o:h")) != -1) {
+        switch (opt) {
+        case 't': max_threads = atoi(optarg); break;
+        case 'n': ops = strtoull(optarg, NULL, 10); break;
+        case 's': slots = strtoull(optarg, NULL, 10); break;
+        case 'x': remote_ratio = atof(optarg); break;
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (max_threads < 1 || ops == 0 || slots == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("Git Version; %s/%s \n", git_date, git_sha);
+    printf("%-16s %-15s %7s %12s %8s %8s %8s %8s %9s\n", "allocator", "sync", "threads",
+           "ops/sec", "scaling", "p50(ns)", "p99(ns)", "p99.9", "max(ns)");
+
+    FILE* json = bench_json_open(out_path, "bench_threads", git_date, git_sha);
+    if (!json) return 1;
+    fprintf(json, "  \"ops_per_thread\": %zu,\n  \"live_slots\": %zu,\n  \"remote_ratio\": %.3f,\n",
+            ops, slots, remote_ratio);
+    fprintf(json, "  \"results\": [\n");
+
+    int first = 1;
+    size_t n_alloc = sizeof(thread_allocators) / sizeof(thread_allocators[0]);
+    for (size_t ai = 0; ai < n_alloc; ai++) {
+        const ThreadAllocator* a = &thread_allocators[ai];
+        double base_throughput = 0;
+
+        for (int nt = 1; nt <= max_threads; nt++) {
+            Worker* workers = calloc(nt, sizeof(Worker));
+            pthread_t* tids = calloc(nt, sizeof(pthread_t));
+            Inbox* inboxes = calloc(nt, sizeof(Inbox));
+            pthread_barrier_t start;
+            pthread_barrier_init(&start, NULL, nt + 1);
+
+            a->init((size_t)nt * (slots + INBOX_CAPACITY) * 512 * 2);
+            for (int i = 0; i < nt; i++) {
+                pthread_mutex_init(&inboxes[i].lock, NULL);
+                workers[i] = (Worker){ a, i, nt, ops, slots, remote_ratio, inboxes, &start,
+                                       calloc(ops, sizeof(uint64_t)), 0, 0, 0 };
+                pthread_create(&tids[i], NULL, worker_main, &workers[i]);
+            }
+
+            pthread_barrier_wait(&start);
+            uint64_t t0 = bench_now_ns();
+            for (int i = 0; i < nt; i++) pthread_join(tids[i], NULL);
+            uint64_t elapsed = bench_now_ns() - t0;
+
+            // Blocks still parked in inboxes belong to nobody now
+            for (int i = 0; i < nt; i++) {
+                void* ptr;
+                while ((ptr = inbox_pop(&inboxes[i])) != NULL) a->release(ptr);
+            }
+            a->deinit();
+
+            double throughput = (double)nt * ops / (elapsed / 1e9);
+            if (nt == 1) base_throughput = throughput;
+            double scaling = base_throughput > 0 ? throughput / base_throughput : 0;
+
+            fprintf(json, "%s    {\"allocator\": \"%s\", \"sync\": \"%s\", \"threads\": %d, "
+                    "\"seconds\": %.9f, \"ops_per_sec\": %.1f, \"scaling\": %.3f, \"per_thread\": [",
+                    first ? "" : ",\n", a->name, a->sync, nt, elapsed / 1e9, throughput, scaling);
+            first = 0;
+
+            uint64_t worst_p50 = 0, worst_p99 = 0, worst_p999 = 0, worst_max = 0;
+            for (int i = 0; i < nt; i++) {
+                Worker* w = &workers[i];
+                qsort(w->latency, w->samples, sizeof(uint64_t), cmp_u64);
+                uint64_t p50 = percentile(w->latency, w->samples, 0.50);
+                uint64_t p99 = percentile(w->latency, w->samples, 0.99);
+                uint64_t p999 = percentile(w->latency, w->samples, 0.999);
+                uint64_t max = w->samples ? w->latency[w->samples - 1] : 0;
+                if (p50 > worst_p50) worst_p50 = p50;
+                if (p99 > worst_p99) worst_p99 = p99;
+                if (p999 > worst_p999) worst_p999 = p999;
+                if (max > worst_max) worst_max = max;
+                fprintf(json, "%s{\"thread\": %d, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+                        "\"max_ns\": %llu, \"remote_frees\": %zu, \"failed_allocs\": %zu}",
+                        i ? ", " : "", i, (unsigned long long)p50, (unsigned long long)p99,
+                        (unsigned long long)p999, (unsigned long long)max, w->remote_frees, w->failed);
+                free(w->latency);
+            }
+            fprintf(json, "]}");
+
+            // Console shows the worst thread, which is what the tail is about
+            printf("%-16s %-15s %7d %12.0f %8.2f %8llu %8llu %8llu %9llu\n", a->name, a->sync, nt,
+                   throughput, scaling, (unsigned long long)worst_p50, (unsigned long long)worst_p99,
+                   (unsigned long long)worst_p999, (unsigned long long)worst_max);
+
+            for (int i = 0; i < nt; i++) pthread_mutex_destroy(&inboxes[i].lock);
+            pthread_barrier_destroy(&start);
+            free(inboxes);
+            free(tids);
+            free(workers);
+        }
+    }
+    fprintf(json, "\n  ]\n");
+    bench_json_close(json);
+    printf("Results written to %s\n", out_path);
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "memory_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "bench_common.h"
+
+#include "gitdata.h"
+
+/**
+ * Long-running fragmentation simulator.
+ *
+ * Every tick releases the objects whose lifetime has expired and then
+ * allocates one new object with a size and lifetime drawn from the configured
+ * distributions. Ticks stand in for wall-clock time, so a few million ticks
+ * approximate a long-lived process. Every sample interval a CSV row records
+ * the pool layout as reported by mem_get_stats.
+ */
+
+typedef struct {
+    uint64_t death;     /**< Tick at which the object is released */
+    void* ptr;
+    size_t size;
+} LiveObject;
+
+/** Min-heap of live objects ordered by death tick */
+typedef struct {
+    LiveObject* items;
+    size_t count;
+    size_t capacity;
+} DeathHeap;
+
+static int heap_push(DeathHeap* h, LiveObject obj) {
+    if (h->count == h->capacity) {
+        size_t cap = h->capacity ? h->capacity * 2 : 1024;
+        LiveObject* items = realloc(h->items, cap * sizeof(LiveObject));
+        if (!items) return -1;
+        h->items = items;
+        h->capacity = cap;
+    }
+    size_t i = h->count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (h->items[parent].death <= obj.death) break;
+        h->items[i] = h->items[parent];
+        i = parent;
+    }
+    h->items[i] = obj;
+    return 0;
+}
+
+static LiveObject heap_pop(DeathHeap* h) {
+    LiveObject top = h->items[0];
+    LiveObject last = h->items[--h->count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && h->items[child + 1].death < h->items[child].death) child++;
+        if (last.death <= h->items[child].death) break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if (h->count > 0) h->items[i] = last;
+    return top;
+}
+
+typedef struct {
+    const char* size_dist;      /**< uniform | pow2 | bimodal */
+    size_t min_size;
+    size_t max_size;
+    const char* life_dist;      /**< exp | uniform | bimodal */
+    double mean_life;           /**< Mean lifetime in ticks */
+    uint64_t ticks;
+    uint64_t interval;          /**< Ticks between CSV samples */
+    size_t pool_size;
+    uint64_t seed;
+    MemFragPolicy frag;         /**< Split threshold, alignment and size classes under test */
+} SimConfig;
+
+static size_t sample_size(const SimConfig* c, BenchRng* rng) {
+    if (strcmp(c->size_dist, "pow2") == 0) {
+        size_t lo = 0, hi = 0;
+        while (((size_t)1 << lo) < c->min_size) lo++;
+        while (((size_t)1 << (hi + 1)) <= c->max_size) hi++;
+        if (hi < lo) hi = lo;
+        return (size_t)1 << bench_rng_range(rng, lo, hi);
+    }
+    if (strcmp(c->size_dist, "bimodal") == 0) {
+        // Mostly small objects with occasional large buffers
+        size_t small_hi = c->min_size + (c->max_size - c->min_size) / 16;
+        if (bench_rng_unit(rng) < 0.9) return bench_rng_range(rng, c->min_size, small_hi);
+        return bench_rng_range(rng, c->max_size / 2, c->max_size);
+    }
+    return bench_rng_range(rng, c->min_size, c->max_size);
+}
+
+static double mean_size(const SimConfig* c) {
+    if (strcmp(c->size_dist, "bimodal") == 0) {
+        size_t small_hi = c->min_size + (c->max_size - c->min_size) / 16;
+        return 0.9 * (c->min_size + small_hi) / 2.0 + 0.1 * (c->max_size * 0.75);
+    }
+    return (c->min_size + c->max_size) / 2.0;
+}
+
+static uint64_t sample_life(const SimConfig* c, BenchRng* rng) {
+    double life;
+    if (strcmp(c->life_dist, "uniform") == 0) {
+        life = bench_rng_unit(rng) * 2.0 * c->mean_life;
+    } else if (strcmp(c->life_dist, "bimodal") == 0) {
+        // Short-lived temporaries mixed with long-lived state, same overall mean
+        life = bench_rng_unit(rng) < 0.9 ? -log(1.0 - bench_rng_unit(rng)) * c->mean_life * 0.1
+                                         : -log(1.0 - bench_rng_unit(rng)) * c->mean_life * 9.1;
+    } else {
+        life = -log(1.0 - bench_rng_unit(rng)) * c->mean_life;
+    }
+    return (uint64_t)life + 1;
+}
+
+static const char* policy_name(MemPolicy p) {
+    switch (p) {
+    case MEM_POLICY_FIRST_FIT: return "first_fit";
+    case MEM_POLICY_NEXT_FIT: return "next_fit";
+    case MEM_POLICY_BEST_FIT: return "best_fit";
+    }
+    return "unknown";
+}
+
+static void write_sample(FILE* csv, const SimConfig* c, MemPolicy policy, uint64_t tick,
+                         size_t live_objects, size_t live_bytes, size_t failures) {
+    MemStats st;
+    mem_get_stats(&st);
+    double ext_frag = st.free_bytes ? 1.0 - (double)st.largest_free_block / st.free_bytes : 0.0;
+    fprintf(csv, "%s,%zu,%zu,%d,%llu,%zu,%zu,%zu,%zu,%.6f,%zu,%zu,%zu,%zu\n", policy_name(policy),
+            c->frag.min_split, c->frag.alignment, c->frag.size_classes, (unsigned long long)tick, live_objects, live_bytes, st.free_bytes,
+            st.largest_free_block, ext_frag, st.block_count, st.free_block_count,
+            st.metadata_bytes, failures);
+}
+
+/**
+ * @brief Run the simulation for one placement policy.
+ */
+static void simulate(const SimConfig* c, MemPolicy policy, FILE* csv) {
+    BenchRng rng;
+    bench_rng_seed(&rng, c->seed);
+    DeathHeap heap = { NULL, 0, 0 };
+
+    if (mem_init(c->pool_size) != 0) {
+        fprintf(stderr, "mem_init(%zu) failed\n", c->pool_size);
+        return;
+    }
+    mem_set_policy(policy);
+    mem_set_frag_policy(&c->frag);
+
+    size_t live_bytes = 0, failures = 0;
+    uint64_t first_failure = 0;
+    size_t first_failure_free = 0;
+    uint64_t alloc_ns = 0, allocs = 0;
+    uint64_t start = bench_now_ns();
+
+    for (uint64_t tick = 1; tick <= c->ticks; tick++) {
+        while (heap.count > 0 && heap.items[0].death <= tick) {
+            LiveObject dead = heap_pop(&heap);
+            mem_free(dead.ptr);
+            live_bytes -= dead.size;
+        }
+
+        size_t size = sample_size(c, &rng);
+        uint64_t life = sample_life(c, &rng);
+        uint64_t t0 = bench_now_ns();
+        void* ptr = mem_alloc(size);
+        alloc_ns += bench_now_ns() - t0;
+        allocs++;
+        if (ptr) {
+            heap_push(&heap, (LiveObject){ tick + life, ptr, size });
+            live_bytes += size;
+        } else {
+            failures++;
+            if (!first_failure) {
+                MemStats st;
+                mem_get_stats(&st);
+                first_failure = tick;
+                first_failure_free = st.free_bytes;
+            }
+        }
+
+        if (tick % c->interval == 0 || tick == c->ticks)
+            write_sample(csv, c, policy, tick, heap.count, live_bytes, failures);
+    }
+    double secs = (bench_now_ns() - start) / 1e9;
+
+    MemStats st;
+    mem_get_stats(&st);
+    printf("%-10s %8.2fs %8.1f ns/alloc %10zu failures, first at tick %llu (%zu bytes free), "
+           "final ext. frag %.3f, %zu blocks\n",
+           policy_name(policy), secs, allocs ? (double)alloc_ns / allocs : 0.0, failures,
+           (unsigned long long)first_failure, first_failure_free,
+           st.free_bytes ? 1.0 - (double)st.largest_free_block / st.free_bytes : 0.0, st.block_count);
+
+    while (heap.count > 0) mem_free(heap_pop(&heap).ptr);
+    free(heap.items);
+    mem_deinit();
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n ticks        operations to simulate (default 1000000)\n");
+    printf("  -d dist         size distribution: uniform | pow2 | bimodal (default uniform)\n");
+    printf("  -a min -b max   size range in bytes (default 16..1024)\n");
+    printf("  -l dist         lifetime distribution: exp | uniform | bimodal (default exp)\n");
+    printf("  -m ticks        mean lifetime (default 1000)\n");
+    printf("  -p bytes        pool size (default 1.25x expected live bytes)\n");
+    printf("  -P policy       first | next | best | all (default all)\n");
+    printf("  -i ticks        sample interval (default 10000)\n");
+    printf("  -S bytes        minimum split remainder (default 0, always split)\n");
+    printf("  -A bytes        alignment quantum, a power of two (default 1)\n");
+    printf("  -C              round sizes to size classes\n");
+    printf("  -s seed         PRNG seed (default 1)\n");
+    printf("  -o file.csv     CSV output (default frag_sim.csv)\n");
+}
+
+int main(int argc, char* argv[]) {
+    SimConfig c = { "uniform", 16, 1024, "exp", 1000.0, 1000000, 10000, 0, 1, { 0, 1, 0 } };
+    const char* policy_arg = "all";
+    const char* out_path = "frag_sim.csv";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:a:b:l:m:p:P:i:S:A:Cs:o:h")) != -1) {
+        switch (opt) {
+        case 'n': c.ticks = strtoull(optarg, NULL, 10); break;
+        case 'd': c.size_dist = optarg; break;
+        case 'a': c.min_size = strtoull(optarg, NULL, 10); break;
+        case 'b': c.max_size = strtoull(optarg, NULL, 10); break;
+        case 'l': c.life_dist = optarg; break;
+        case 'm': c.mean_life = atof(optarg); break;
+        case 'p': c.pool_size = strtoull(optarg, NULL, 10); break;
+        case 'P': policy_arg = optarg; break;
+        case 'i': c.interval = strtoull(optarg, NULL, 10); break;
+        case 'S': c.frag.min_split = strtoull(optarg, NULL, 10); break;
+        case 'A': c.frag.alignment = strtoull(optarg, NULL, 10); break;
+        case 'C': c.frag.size_classes = 1; break;
+        case 's': c.seed = strtoull(optarg, NULL, 10); break;
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (c.ticks == 0 || c.interval == 0 || c.min_size == 0 || c.max_size < c.min_size || c.mean_life <= 0 ||
+        mem_set_frag_policy(&c.frag) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (c.pool_size == 0) c.pool_size = (size_t)(1.25 * mean_size(&c) * c.mean_life);
+
+    MemPolicy policies[3];
+    int n_policies = 0;
+    if (strcmp(policy_arg, "first") == 0 || strcmp(policy_arg, "all") == 0) policies[n_policies++] = MEM_POLICY_FIRST_FIT;
+    if (strcmp(policy_arg, "next") == 0 || strcmp(policy_arg, "all") == 0) policies[n_policies++] = MEM_POLICY_NEXT_FIT;
+    if (strcmp(policy_arg, "best") == 0 || strcmp(policy_arg, "all") == 0) policies[n_policies++] = MEM_POLICY_BEST_FIT;
+    if (n_policies == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE* csv = fopen(out_path, "w");
+    if (!csv) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(csv, "policy,min_split,alignment,size_classes,tick,live_objects,live_bytes,free_bytes,largest_free_block,"
+                 "external_fragmentation,block_count,free_block_count,metadata_bytes,failures\n");
+
+    printf("Git Version; %s/%s \n", git_date, git_sha);
+    printf("pool %zu bytes, %llu ticks, sizes %s [%zu, %zu], lifetimes %s mean %.0f\n", c.pool_size,
+           (unsigned long long)c.ticks, c.size_dist, c.min_size, c.max_size, c.life_dist, c.mean_life);
+    printf("min split %zu, alignment %zu, size classes %s\n", c.frag.min_split, c.frag.alignment,
+           c.frag.size_classes ? "on" : "off");
+    for (int k = 0; k < n_policies; k++) simulate(&c, policies[k], csv);
+
+    fclose(csv);
+    printf("Time series written to %s\n", out_path);
+    return 0;
+}
@@ -0,0 +1,525 @@
+#include "memory_manager.h"
+#include "memory_manager_inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench_common.h"
+
+/**
+ * Differential fuzz harness.
+ *
+ * A test case is a sequence of init / alloc / free / resize operations on a
+ * fixed number of slots. Every backend replays the case while a reference
+ * model tracks what each slot should hold. After every operation the harness
+ * checks that live blocks do not overlap, that every block still holds the
+ * bytes written into it (including across resize), and that the pool layout
+ * reported by mem_get_stats is consistent with the model. A failing case is
+ * shrunk by deleting operations and halving sizes while it keeps failing.
+ *
+ * Built with -DFUZZ_LIBFUZZER the same checks run under libFuzzer, which
+ * decodes its input bytes into operations. Otherwise main() generates cases
+ * with its own PRNG.
+ */
+
+#define FUZZ_SLOTS 32
+#define FUZZ_MAX_OPS 4096
+
+typedef enum { OP_INIT, OP_ALLOC, OP_FREE, OP_RESIZE } FuzzOpKind;
+
+typedef struct {
+    FuzzOpKind kind;
+    unsigned slot;
+    size_t size;
+} FuzzOp;
+
+/**
+ * @struct FuzzBackend
+ * @brief One configuration of the memory manager under test.
+ *
+ * @var setup Selects the configuration; called before every mem_init.
+ * @var teardown Restores the default configuration before mem_deinit.
+ * @var settle Brings the pool to a state where freed space is merged.
+ * @var eager Non-zero if adjacent free blocks are merged on every free.
+ * @var alignment Alignment every returned pointer must have.
+ */
+typedef struct {
+    const char* name;
+    void (*setup)(void);
+    void (*teardown)(void);
+    void* (*alloc)(size_t size);
+    void (*release)(void* ptr);
+    void* (*resize)(void* ptr, size_t old_size, size_t size);
+    void (*settle)(void);
+    int eager;
+    size_t alignment;
+} FuzzBackend;
+
+static void no_setup(void) {}
+static void no_settle(void) {}
+static void* mm_resize(void* ptr, size_t old_size, size_t size) { (void)old_size; return mem_resize(ptr, size); }
+
+static void defaults(void) {
+    mem_set_policy(MEM_POLICY_FIRST_FIT);
+    mem_set_frag_policy(NULL);
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+}
+
+static void best_fit_setup(void) { mem_set_policy(MEM_POLICY_BEST_FIT); }
+static void next_fit_setup(void) { mem_set_policy(MEM_POLICY_NEXT_FIT); }
+static void deferred_setup(void) { mem_set_coalescing(MEM_COALESCE_DEFERRED, 8); }
+
+static void frag_setup(void) {
+    MemFragPolicy policy = { 32, 16, 1 };
+    mem_set_frag_policy(&policy);
+}
+
+static void* inline_alloc(size_t size) { return mem_alloc_inline(size); }
+static void inline_free(void* ptr) { mem_free_inline(ptr); }
+
+// The inline fast path has no resize; emulate it the way a caller would
+static void* inline_resize(void* ptr, size_t old_size, size_t size) {
+    if (size == 0) {
+        mem_free_inline(ptr);
+        return NULL;
+    }
+    void* new_ptr = mem_alloc_inline(size);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        mem_free_inline(ptr);
+    }
+    return new_ptr;
+}
+
+static void inline_teardown(void) {
+    mem_tcache_flush();
+    defaults();
+}
+
+static void page_bags_setup(void) {
+    MemPageBags config = { 4, 128 };
+    mem_set_page_bags(&config);
+}
+
+// Returning the pages fails while any object is still live
+static void page_bags_settle(void) {
+    MemPageBags config = { 4, 128 };
+    if (mem_set_page_bags(NULL) == 0) mem_set_page_bags(&config);
+}
+
+static void page_bags_teardown(void) {
+    mem_set_page_bags(NULL);
+    defaults();
+}
+
+static const FuzzBackend fuzz_backends[] = {
+    { "first_fit", no_setup, defaults, mem_alloc, mem_free, mm_resize, no_settle, 1, 1 },
+    { "best_fit", best_fit_setup, defaults, mem_alloc, mem_free, mm_resize, no_settle, 1, 1 },
+    { "next_fit", next_fit_setup, defaults, mem_alloc, mem_free, mm_resize, no_settle, 1, 1 },
+    { "deferred", deferred_setup, defaults, mem_alloc, mem_free, mm_resize, mem_coalesce, 0, 1 },
+    { "frag_policy", frag_setup, defaults, mem_alloc, mem_free, mm_resize, no_settle, 1, 16 },
+    { "page_bags", page_bags_setup, page_bags_teardown, mem_alloc, mem_free, mm_resize, page_bags_settle, 0, 1 },
+    { "inline_cache", no_setup, inline_teardown, inline_alloc, inline_free, inline_resize, mem_tcache_flush, 0, 16 },
+};
+
+/** What the reference model knows about one slot */
+typedef struct {
+    unsigned char* ptr;
+    size_t size;
+    unsigned char tag;      /**< Seed of the byte pattern written into the block */
+} ModelSlot;
+
+typedef struct {
+    int initialized;
+    size_t pool_size;
+    ModelSlot slots[FUZZ_SLOTS];
+    unsigned char next_tag;
+} Model;
+
+static unsigned char pattern(unsigned char tag, size_t i) { return (unsigned char)(tag + i * 31 + (i >> 8)); }
+
+static void fill(ModelSlot* slot) {
+    for (size_t i = 0; i < slot->size; i++) slot->ptr[i] = pattern(slot->tag, i);
+}
+
+/** @return Index of the first byte that differs from the slot's pattern, or size if intact. */
+static size_t verify(const ModelSlot* slot, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (slot->ptr[i] != pattern(slot->tag, i)) return i;
+    }
+    return size;
+}
+
+/** Failure description of the last run, empty when it passed */
+static char fuzz_failure[256];
+
+#define FAIL(...) do { snprintf(fuzz_failure, sizeof(fuzz_failure), __VA_ARGS__); return -1; } while (0)
+
+/**
+ * @brief Check a freshly returned block against the model.
+ */
+static int check_new_block(const FuzzBackend* b, const Model* m, unsigned slot, unsigned char* ptr, size_t size) {
+    if ((uintptr_t)ptr % b->alignment) FAIL("block %p is not %zu-byte aligned", (void*)ptr, b->alignment);
+    for (unsigned k = 0; k < FUZZ_SLOTS; k++) {
+        const ModelSlot* other = &m->slots[k];
+        if (k == slot || !other->ptr) continue;
+        if (ptr < other->ptr + other->size && other->ptr < ptr + size)
+            FAIL("block [%p, +%zu) of slot %u overlaps slot %u [%p, +%zu)", (void*)ptr, size, slot, k,
+                 (void*)other->ptr, other->size);
+    }
+    return 0;
+}
+
+/**
+ * @brief Compare the pool layout with the model.
+ *
+ * Used and free bytes must add up to the pool, every live byte must be inside
+ * an allocated block, and with eager coalescing no two free blocks may touch,
+ * so there can be at most one more free block than allocated blocks.
+ */
+static int check_layout(const FuzzBackend* b, const Model* m) {
+    MemStats st;
+    mem_get_stats(&st);
+    if (st.used_bytes + st.free_bytes != m->pool_size)
+        FAIL("used %zu + free %zu != pool %zu", st.used_bytes, st.free_bytes, m->pool_size);
+    if (st.largest_free_block > st.free_bytes)
+        FAIL("largest free block %zu exceeds free bytes %zu", st.largest_free_block, st.free_bytes);
+
+    size_t live_bytes = 0;
+    for (unsigned k = 0; k < FUZZ_SLOTS; k++) live_bytes += m->slots[k].size;
+    if (live_bytes > st.used_bytes) FAIL("model holds %zu live bytes, pool only %zu used", live_bytes, st.used_bytes);
+
+    size_t allocated_blocks = st.block_count - st.free_block_count;
+    if (b->eager && st.free_block_count > allocated_blocks + 1)
+        FAIL("%zu free blocks around %zu allocated blocks: adjacent free blocks were not merged",
+             st.free_block_count, allocated_blocks);
+    return 0;
+}
+
+/**
+ * @brief Free every live slot, settle the pool and check that it is one free block again.
+ */
+static int drain(const FuzzBackend* b, Model* m) {
+    for (unsigned k = 0; k < FUZZ_SLOTS; k++) {
+        ModelSlot* slot = &m->slots[k];
+        if (!slot->ptr) continue;
+        size_t bad = verify(slot, slot->size);
+        if (bad != slot->size) FAIL("slot %u corrupted at byte %zu before final free", k, bad);
+        b->release(slot->ptr);
+        slot->ptr = NULL;
+        slot->size = 0;
+    }
+    b->settle();
+
+    MemStats st;
+    mem_get_stats(&st);
+    if (st.block_count != 1 || st.free_bytes != m->pool_size)
+        FAIL("after freeing everything: %zu blocks, %zu of %zu bytes free", st.block_count, st.free_bytes,
+             m->pool_size);
+    return 0;
+}
+
+/**
+ * @brief Replay ops on one backend.
+ *
+ * @return 0 if every check passed, -1 with fuzz_failure set otherwise.
+ */
+static int run_case(const FuzzBackend* b, const FuzzOp* ops, size_t n_ops, size_t* failed_at) {
+    Model m;
+    memset(&m, 0, sizeof(m));
+    fuzz_failure[0] = '\0';
+    int result = 0;
+
+    for (size_t i = 0; i < n_ops && result == 0; i++) {
+        const FuzzOp* op = &ops[i];
+        ModelSlot* slot = &m.slots[op->slot % FUZZ_SLOTS];
+        *failed_at = i;
+
+        switch (op->kind) {
+        case OP_INIT:
+            if (m.initialized) {
+                result = drain(b, &m);
+                b->teardown();
+                mem_deinit();
+                if (result) break;
+            }
+            b->setup();
+            if (mem_init(op->size) != 0) {
+                snprintf(fuzz_failure, sizeof(fuzz_failure), "mem_init(%zu) failed", op->size);
+                result = -1;
+                break;
+            }
+            m.initialized = 1;
+            m.pool_size = op->size;
+            break;
+
+        case OP_ALLOC: {
+            if (slot->ptr) {  // The slot is busy; treat the op as a free first
+                b->release(slot->ptr);
+                slot->ptr = NULL;
+                slot->size = 0;
+            }
+            unsigned char* ptr = b->alloc(op->size);
+            if (!m.initialized) {
+                if (ptr) {
+                    snprintf(fuzz_failure, sizeof(fuzz_failure), "allocation succeeded without a pool");
+                    result = -1;
+                }
+                break;
+            }
+            if (!ptr) {
+                // Only an empty pool that is large enough must satisfy a request
+                size_t live = 0;
+                for (unsigned k = 0; k < FUZZ_SLOTS; k++) live += m.slots[k].ptr != NULL;
+                if (live == 0 && b->eager && b->alignment == 1 && op->size <= m.pool_size) {
+                    snprintf(fuzz_failure, sizeof(fuzz_failure), "alloc(%zu) failed on an empty pool of %zu bytes",
+                             op->size, m.pool_size);
+                    result = -1;
+                }
+                break;
+            }
+            result = check_new_block(b, &m, op->slot % FUZZ_SLOTS, ptr, op->size);
+            slot->ptr = ptr;
+            slot->size = op->size;
+            slot->tag = ++m.next_tag;
+            fill(slot);
+            break;
+        }
+
+        case OP_FREE:
+            if (!slot->ptr) break;
+            if (verify(slot, slot->size) != slot->size) {
+                snprintf(fuzz_failure, sizeof(fuzz_failure), "slot %u corrupted before free", op->slot % FUZZ_SLOTS);
+                result = -1;
+                break;
+            }
+            b->release(slot->ptr);
+            slot->ptr = NULL;
+            slot->size = 0;
+            break;
+
+        case OP_RESIZE: {
+            if (!slot->ptr) break;
+            unsigned char* ptr = b->resize(slot->ptr, slot->size, op->size);
+            if (op->size == 0) {
+                slot->ptr = NULL;
+                slot->size = 0;
+                break;
+            }
+            if (!ptr) {
+                // A failed resize must leave the old block intact
+                if (verify(slot, slot->size) != slot->size) {
+                    snprintf(fuzz_failure, sizeof(fuzz_failure), "failed resize to %zu corrupted the block", op->size);
+                    result = -1;
+                }
+                break;
+            }
+            size_t kept = slot->size < op->size ? slot->size : op->size;
+            slot->ptr = ptr;
+            size_t bad = verify(slot, kept);
+            if (bad != kept) {
+                snprintf(fuzz_failure, sizeof(fuzz_failure), "resize %zu -> %zu lost data at byte %zu", slot->size,
+                         op->size, bad);
+                result = -1;
+                break;
+            }
+            slot->size = op->size;
+            result = check_new_block(b, &m, op->slot % FUZZ_SLOTS, ptr, op->size);
+            fill(slot);
+            break;
+        }
+        }
+
+        if (result == 0 && m.initialized) result = check_layout(b, &m);
+    }
+
+    if (m.initialized) {
+        if (result == 0) {
+            *failed_at = n_ops;
+            result = drain(b, &m);
+        }
+        b->teardown();
+        mem_deinit();
+    }
+    return result;
+}
+
+/**
+ * @brief Shrink a failing case while it keeps failing on the same backend.
+ *
+ * Chunks of operations are deleted, from half the case down to single
+ * operations, then every remaining size is halved as far as possible.
+ *
+ * @return The length of the shrunk case, which replaces ops in place.
+ */
+static size_t shrink_case(const FuzzBackend* b, FuzzOp* ops, size_t n_ops) {
+    FuzzOp* trial = malloc(n_ops * sizeof(FuzzOp));
+    size_t where;
+    if (!trial) return n_ops;
+
+    for (size_t chunk = n_ops / 2; chunk >= 1; chunk /= 2) {
+        for (size_t start = 0; start + chunk <= n_ops;) {
+            size_t n_trial = 0;
+            for (size_t i = 0; i < n_ops; i++) {
+                if (i < start || i >= start + chunk) trial[n_trial++] = ops[i];
+            }
+            if (run_case(b, trial, n_trial, &where) != 0) {
+                memcpy(ops, trial, n_trial * sizeof(FuzzOp));
+                n_ops = n_trial;
+            } else {
+                start += chunk;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n_ops; i++) {
+        while (ops[i].size > 1) {
+            size_t saved = ops[i].size;
+            ops[i].size /= 2;
+            if (run_case(b, ops, n_ops, &where) == 0) {
+                ops[i].size = saved;
+                break;
+            }
+        }
+    }
+    free(trial);
+    run_case(b, ops, n_ops, &where);  // Leave fuzz_failure describing the shrunk case
+    return n_ops;
+}
+
+static const char* op_name(FuzzOpKind kind) {
+    switch (kind) {
+    case OP_INIT: return "init";
+    case OP_ALLOC: return "alloc";
+    case OP_FREE: return "free";
+    case OP_RESIZE: return "resize";
+    }
+    return "?";
+}
+
+static void print_case(FILE* out, const FuzzOp* ops, size_t n_ops) {
+    for (size_t i = 0; i < n_ops; i++) {
+        if (ops[i].kind == OP_INIT) fprintf(out, "init %zu\n", ops[i].size);
+        else if (ops[i].kind == OP_FREE) fprintf(out, "free %u\n", ops[i].slot % FUZZ_SLOTS);
+        else fprintf(out, "%s %u %zu\n", op_name(ops[i].kind), ops[i].slot % FUZZ_SLOTS, ops[i].size);
+    }
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+/**
+ * @brief Decode raw bytes into operations: 4 bytes per operation.
+ *
+ * Byte 0 selects the kind and slot, bytes 1-3 the size. The case always
+ * starts with an init so most inputs exercise a live pool.
+ */
+static size_t decode_case(const uint8_t* data, size_t len, FuzzOp* ops, size_t max_ops) {
+    size_t n_ops = 0;
+    ops[n_ops++] = (FuzzOp){ OP_INIT, 0, 4096 };
+    for (size_t i = 0; i + 4 <= len && n_ops < max_ops; i += 4) {
+        size_t raw = (size_t)data[i + 1] | (size_t)data[i + 2] << 8 | (size_t)data[i + 3] << 16;
+        unsigned selector = data[i] % 16;
+        FuzzOp op = { OP_ALLOC, data[i] / 16 % FUZZ_SLOTS, raw % 1024 + 1 };
+        if (selector == 0) op = (FuzzOp){ OP_INIT, 0, raw % 65536 + 64 };
+        else if (selector < 6) op.kind = OP_FREE;
+        else if (selector < 9) op.kind = OP_RESIZE, op.size = raw % 2048;
+        ops[n_ops++] = op;
+    }
+    return n_ops;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t len) {
+    static FuzzOp ops[FUZZ_MAX_OPS];
+    size_t n_ops = decode_case(data, len, ops, FUZZ_MAX_OPS);
+    size_t where;
+    for (size_t k = 0; k < sizeof(fuzz_backends) / sizeof(fuzz_backends[0]); k++) {
+        if (run_case(&fuzz_backends[k], ops, n_ops, &where) != 0) {
+            fprintf(stderr, "%s: op %zu: %s\n", fuzz_backends[k].name, where, fuzz_failure);
+            print_case(stderr, ops, n_ops);
+            abort();
+        }
+    }
+    return 0;
+}
+
+#else
+
+/**
+ * @brief Generate a random case: a pool size, then a mix of operations.
+ *
+ * Sizes are drawn from a few scales so that both tiny blocks and requests
+ * near the pool size occur; occasional re-inits change the pool size.
+ */
+static size_t generate_case(BenchRng* rng, FuzzOp* ops, size_t n_ops) {
+    size_t pool = (size_t)1 << bench_rng_range(rng, 8, 16);
+    ops[0] = (FuzzOp){ OP_INIT, 0, pool + bench_rng_range(rng, 0, 63) };
+    for (size_t i = 1; i < n_ops; i++) {
+        size_t scale = (size_t)1 << bench_rng_range(rng, 3, 12);
+        double r = bench_rng_unit(rng);
+        FuzzOp op = { OP_ALLOC, (unsigned)bench_rng_range(rng, 0, FUZZ_SLOTS - 1), bench_rng_range(rng, 1, scale) };
+        if (r < 0.01) op = (FuzzOp){ OP_INIT, 0, ((size_t)1 << bench_rng_range(rng, 8, 16)) + bench_rng_range(rng, 0, 63) };
+        else if (r < 0.40) op.kind = OP_FREE;
+        else if (r < 0.60) op.kind = OP_RESIZE, op.size = bench_rng_range(rng, 0, scale);
+        ops[i] = op;
+    }
+    return n_ops;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [-n cases] [-l ops_per_case] [-s seed] [-b backend] [-o failing_case.txt]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    size_t cases = 2000;
+    size_t length = 200;
+    uint64_t seed = 1;
+    const char* only = NULL;
+    const char* out_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:s:b:o:h")) != -1) {
+        switch (opt) {
+        case 'n': cases = strtoull(optarg, NULL, 10); break;
+        case 'l': length = strtoull(optarg, NULL, 10); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        case 'b': only = optarg; break;
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (length < 1 || length > FUZZ_MAX_OPS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static FuzzOp ops[FUZZ_MAX_OPS];
+    BenchRng rng;
+    bench_rng_seed(&rng, seed);
+    for (size_t c = 0; c < cases; c++) {
+        size_t n_ops = generate_case(&rng, ops, length);
+        for (size_t k = 0; k < sizeof(fuzz_backends) / sizeof(fuzz_backends[0]); k++) {
+            const FuzzBackend* b = &fuzz_backends[k];
+            size_t where;
+            if (only && strcmp(only, b->name) != 0) continue;
+            if (run_case(b, ops, n_ops, &where) == 0) continue;
+
+            printf("FAIL %s, case %zu (seed %llu), op %zu: %s\n", b->name, c, (unsigned long long)seed, where,
+                   fuzz_failure);
+            n_ops = shrink_case(b, ops, n_ops);
+            printf("Shrunk to %zu ops: %s\n", n_ops, fuzz_failure);
+            print_case(stdout, ops, n_ops);
+            if (out_path) {
+                FILE* out = fopen(out_path, "w");
+                if (out) {
+                    print_case(out, ops, n_ops);
+                    fclose(out);
+                }
+            }
+            return 1;
+        }
+    }
+    printf("%zu cases of %zu ops passed on every backend\n", cases, length);
+    return 0;
+}
+
+#endif // FUZZ_LIBFUZZER
@@ -1,7 +1,19 @@
+#define _GNU_SOURCE  // memfd_create
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "memory_manager.h"
+#include "memory_manager_inline.h"
 
 /**
  * @struct MemBlock
@@ -9,237 +21,4079 @@
  *
  * @var offset Offset of the block from the start of the memory pool.
  * @var size Size of the memory block in bytes.
- * @var is_block_free Flag indicating if the block is free (1) or allocated (0).
+ * @var is_block_free Flag indicating if the block is free (1), allocated (0),
+ *      freed but not yet coalesced (MEM_BLOCK_DEFERRED), the extent of a child
+ *      pool (MEM_BLOCK_SUBPOOL), of the small-block region (MEM_BLOCK_SMALL) or
+ *      of the page bags (MEM_BLOCK_BAGS).
  * @var next Pointer to the next memory block in the linked list.
+ * @var prev Pointer to the previous memory block in the linked list.
+ * @var next_quick Pointer to the next block on the same quick list (deferred mode).
+ * @var handle Handle that owns the block, or 0 for a plain mem_alloc block.
+ * @var table_slot Entry of the block in its pool's block table (see MemPool).
  */
 typedef struct MemBlock {
     size_t offset;          /**< Offset from the start of the memory pool */
     size_t size;            /**< Size of the memory block */
-    int is_block_free;      /**< 1 if block is free, 0 if allocated */
+    int is_block_free;      /**< 1 if block is free, 0 if allocated, 2 if deferred, 3 to 5 if an extent */
+    uint32_t table_slot;    /**< Entry in the pool's block table */
     struct MemBlock* next;  /**< Pointer to next block in the list */
+    struct MemBlock* prev;  /**< Pointer to previous block in the list */
+    struct MemBlock* next_quick;  /**< Pointer to next block on its quick list */
+    uint32_t handle;        /**< Owning handle (mem_handle_alloc), 0 if none */
 } MemBlock;
 
-/** Head pointer to the linked list of memory blocks */
-static MemBlock* mem_block_list = NULL;
+/**
+ * @struct MemHandleEntry
+ * @brief Slot of the handle indirection table.
+ *
+ * Entries are 16 bytes and live in one contiguous array, so resolving a handle
+ * is a single indexed load. Free slots are chained through next_free.
+ *
+ * @var block Block currently backing the handle, NULL if the slot is free.
+ * @var pins Number of outstanding mem_handle_lock calls; pinned blocks never move.
+ * @var next_free Index + 1 of the next free slot (0 ends the chain).
+ */
+typedef struct {
+    MemBlock* block;
+    uint32_t pins;
+    uint32_t next_free;
+} MemHandleEntry;
+
+/** is_block_free value of a block parked on a quick list, waiting to be coalesced */
+#define MEM_BLOCK_DEFERRED 2
+
+/** is_block_free value of a parent block that holds the extent of a child pool */
+#define MEM_BLOCK_SUBPOOL 3
+
+/** is_block_free value of the block that holds the small-block region */
+#define MEM_BLOCK_SMALL 4
+
+/** is_block_free value of the block that holds the page bags */
+#define MEM_BLOCK_BAGS 5
 
-/** Pointer to the start of the allocated memory pool */
-static char* mem_pool = NULL;
+/** Size of one page bag; every object in it has the same size */
+#define MEM_BAG_PAGE 4096
 
-/** Total size of the memory pool in bytes */
-static size_t mem_pool_size = 0;
+/** Page bag object sizes are multiples of this */
+#define MEM_BAG_GRANULE 8
+
+/** Largest object size served from page bags */
+#define MEM_BAG_MAX 512
+
+/** Blocks smaller than this get an exact-size quick list; larger ones merge eagerly */
+#define MEM_QUICK_BINS 1024
 
 /**
- * @brief Initialize the memory pool with a given size.
+ * @struct MemBagPage
+ * @brief Descriptor of one page bag, kept outside the pool.
  *
- * Allocates the memory pool and sets up the initial free block covering the entire pool.
+ * The page an object lives in follows from its address, and the page's
+ * descriptor gives the object size, so objects carry no header. Pages with
+ * free slots are chained per size on a partial list; pages with no live
+ * object go back to the empty list and may take another size.
  *
- * @param size Size of the memory pool to allocate in bytes.
- * @return 0 on success, -1 on failure (e.g., already initialized or malloc failure).
+ * @var size Object size of the page, 0 while the page is on the empty list.
+ * @var live Objects currently allocated from the page.
+ * @var prev Index + 1 of the previous page on the page's list (0 = none).
+ * @var next Index + 1 of the next page on the page's list (0 = none).
+ * @var free_bits One bit per slot, set while the slot is free.
  */
+typedef struct {
+    uint16_t size;
+    uint16_t live;
+    uint32_t prev;
+    uint32_t next;
+    uint64_t free_bits[MEM_BAG_PAGE / MEM_BAG_GRANULE / 64];
+} MemBagPage;
 
-int mem_init(size_t size) {
-    if (mem_pool != NULL) return -1;
+/**
+ * @struct MemPool
+ * @brief Allocator state of one pool: the global pool or a child carved from a parent.
+ *
+ * Block nodes, the dirty-page bitmap and the placement and coalescing settings
+ * are shared by every pool; the block list, its index and the quick lists are
+ * per pool. A child's extent is a single block of its parent, marked
+ * MEM_BLOCK_SUBPOOL there so mem_free on the parent ignores it.
+ *
+ * @var base Start of the pool's memory.
+ * @var size Size of the pool in bytes.
+ * @var root_offset Offset of base from the start of the global pool; locates
+ *      the pool's pages in the dirty-page bitmap.
+ * @var block_list Head of the pool's block list.
+ * @var block_index Open-addressing hash index of every allocated or deferred
+ *      block, keyed by offset, so mem_free and friends find a block without
+ *      walking the list. Capacity is a power of two and the load factor is kept
+ *      at or below 1/2.
+ * @var index_capacity Number of slots in block_index.
+ * @var index_count Number of blocks stored in block_index.
+ * @var table_offset Block table: offset of every block of the pool, in no particular order.
+ * @var table_fit Block table: size of each free block, 0 for any other block, so
+ *      a single unsigned comparison tests both "free" and "large enough".
+ * @var table_block Block table: the MemBlock each entry describes.
+ * @var table_count Number of entries in the block table.
+ * @var table_capacity Entries allocated for each block table array.
+ * @var table_enabled Non-zero if the pool keeps a block table; offsets and
+ *      sizes are 32 bits wide, so only pools under 4 GiB do.
+ * @var next_fit_offset Offset just past the previous allocation, where next-fit resumes its search.
+ * @var quick_bins Quick lists of deferred blocks, indexed by exact size.
+ * @var deferred_count Number of blocks currently parked on the quick lists.
+ * @var parent Pool the extent was carved from, NULL for the global pool.
+ * @var children First child pool; siblings are chained through next_sibling.
+ * @var steal_min Smallest extent the pool takes from a sibling when it runs
+ *      out of room, 0 if it never steals (see mem_pool_set_stealing).
+ * @var loans Extents this pool took from its siblings, chained through next_loan.
+ *      Each is a child pool of the sibling that lent it.
+ * @var borrower For a loan, the pool it serves; NULL for any other pool.
+ */
+struct MemPool {
+    char* base;
+    size_t size;
+    size_t root_offset;
+    MemBlock* block_list;
+    MemBlock** block_index;
+    size_t index_capacity;
+    size_t index_count;
+    uint32_t* table_offset;
+    uint32_t* table_fit;
+    MemBlock** table_block;
+    size_t table_count;
+    size_t table_capacity;
+    int table_enabled;
+    size_t next_fit_offset;
+    MemBlock* quick_bins[MEM_QUICK_BINS];
+    size_t deferred_count;
+    MemPool* parent;
+    MemPool* children;
+    MemPool* next_sibling;
+    size_t steal_min;
+    MemPool* loans;
+    MemPool* next_loan;
+    MemPool* borrower;
+};
 
-    mem_pool = malloc(size);
-    if (!mem_pool) return -1;
+/** The global pool set up by mem_init; every public function without a MemPool argument uses it */
+static MemPool mem_root;
 
-    mem_pool_size = size;
+/** File the global pool is mapped from (MemInitOptions.backing_file), -1 for anonymous memory */
+static int mem_pool_fd = -1;
 
-    // Setup initial free block covering entire pool
-    mem_block_list = (MemBlock*)malloc(sizeof(MemBlock));
-    if (!mem_block_list) return -1;
+/** Size of an OS page, the granularity of known-zero tracking */
+static size_t mem_page_size = 4096;
+
+/**
+ * One bit per pool page; a set bit means the page may hold non-zero data.
+ * Clear pages are known to be zero: freshly mapped, or decommitted by mem_trim.
+ * The metadata arena holds nothing else.
+ */
+static uint64_t* mem_dirty_pages = NULL;
+
+/**
+ * Metadata arena: the dirty-page bitmap, in one mapping whose pages are
+ * committed on first touch. MemBlock nodes live in node chunks mapped as the
+ * block count grows, each twice the size of the last, so reservations track
+ * the blocks actually in use and mem_deinit drops all nodes with a few
+ * munmaps instead of walking the list.
+ */
+static char* mem_meta_arena = NULL;
+
+/** Bytes reserved for mem_meta_arena */
+static size_t mem_meta_size = 0;
+
+/** Nodes in the first node chunk; each later chunk holds twice as many as the one before */
+#define MEM_META_FIRST_CHUNK 4096
+
+/** Node chunks mapped so far; 48 doublings hold more nodes than any address space */
+#define MEM_META_MAX_CHUNKS 48
+static MemBlock* mem_node_chunks[MEM_META_MAX_CHUNKS];
+static size_t mem_node_chunk_count = 0;
+
+/** Newest node chunk, which nodes are carved from */
+static MemBlock* mem_nodes = NULL;
+
+/** Number of MemBlock slots in the newest chunk */
+static size_t mem_node_capacity = 0;
+
+/** Slots of the newest chunk handed out so far; slots past this were never touched */
+static size_t mem_node_used = 0;
+
+/** Released MemBlock nodes, chained through next */
+static MemBlock* mem_node_free_list = NULL;
+
+/** Placement policy used when searching for a free block */
+static MemPolicy mem_policy = MEM_POLICY_FIRST_FIT;
+
+/** Split threshold, size-class rounding and alignment applied to every request */
+static MemFragPolicy mem_frag_policy = { 0, 1, 0 };
+
+/** Whether mem_free merges neighbours immediately or parks blocks on quick lists */
+static MemCoalesceMode mem_coalesce_mode = MEM_COALESCE_EAGER;
+
+/** Number of deferred blocks that triggers a batch coalesce (0 = only on failure) */
+static size_t mem_coalesce_threshold = 0;
+
+/** Handle indirection table; handle h refers to mem_handles[h - 1] */
+static MemHandleEntry* mem_handles = NULL;
+
+/** Allocated slots in mem_handles */
+static uint32_t mem_handle_capacity = 0;
+
+/** Index + 1 of the first free slot in mem_handles (0 if none) */
+static uint32_t mem_handle_free_list = 0;
+
+/** Allocated block that backs the open regions, NULL when no region is open */
+static MemBlock* mem_region_block = NULL;
+
+/** Pool offset of the region bump pointer */
+static size_t mem_region_top = 0;
+
+/**
+ * Pool offset of every live region allocation, in bump order, so each one's size
+ * is the distance to the next. The newest may be resized in place. Lives
+ * outside the pool like the block index.
+ */
+static size_t* mem_region_starts = NULL;
+
+/** Entries in use and allocated in mem_region_starts */
+static size_t mem_region_count = 0;
+static size_t mem_region_capacity = 0;
+
+/** Number of open (nested) regions */
+static mem_region_t mem_region_depth = 0;
+
+/** Bump pointer saved by each mem_region_begin, indexed by mark - 1 */
+static size_t mem_region_marks[MEM_REGION_MAX_DEPTH];
+
+/** Small-block region settings, see mem_set_small_blocks; region_size 0 disables it */
+static MemSmallBlocks mem_small_config = { 0, 16, 128 };
+
+/** Block of the global pool holding the small-block region, NULL until the first small request */
+static MemBlock* mem_small_block = NULL;
+
+/** Pool offset of the first granule (the extent start rounded up to a granule) */
+static size_t mem_small_start = 0;
+
+/** log2 of the granule size */
+static unsigned mem_small_shift = 4;
+
+/** One bit per granule, set while the granule is free */
+static uint64_t* mem_small_free = NULL;
+
+/** One bit per granule, set on the last granule of every allocation */
+static uint64_t* mem_small_ends = NULL;
+
+/** Pool offset just past the last granule */
+static size_t mem_small_end = 0;
+
+/** Number of 64-bit words in each small-block bitmap */
+static size_t mem_small_words = 0;
+
+/** Bitmap word where the next search starts (the last word that satisfied one) */
+static size_t mem_small_hint = 0;
+
+/** Granules currently allocated from the small-block region */
+static size_t mem_small_used = 0;
+
+/** Set once carving the region failed, so later requests do not retry it */
+static int mem_small_unavailable = 0;
+
+/** Page bag settings, see mem_set_page_bags; pages 0 disables them */
+static MemPageBags mem_bag_config = { 0, 64 };
+
+/** Block of the global pool holding the page bags, NULL until the first request for them */
+static MemBlock* mem_bag_block = NULL;
+
+/** Pool offset of the first page bag (the extent start rounded up to MEM_BAG_PAGE) */
+static size_t mem_bag_start = 0;
+
+/** Pool offset just past the last page bag */
+static size_t mem_bag_end = 0;
+
+/** Descriptor of every page bag, indexed by (offset - mem_bag_start) / MEM_BAG_PAGE */
+static MemBagPage* mem_bag_pages = NULL;
+
+/** Number of page bags */
+static size_t mem_bag_count = 0;
+
+/** Head (index + 1) of the list of pages with free slots, per object size / MEM_BAG_GRANULE */
+static uint32_t mem_bag_partial[MEM_BAG_MAX / MEM_BAG_GRANULE + 1];
 
-    mem_block_list->offset = 0;
-    mem_block_list->size = size;
-    mem_block_list->is_block_free = 1;
-    mem_block_list->next = NULL;
+/** Head (index + 1) of the list of pages without a size */
+static uint32_t mem_bag_empty = 0;
 
+/** Objects currently allocated from page bags */
+static size_t mem_bag_live = 0;
+
+/** Set once carving the page bags failed, so later requests do not retry it */
+static int mem_bag_unavailable = 0;
+
+/**
+ * Serializes the public API while the maintenance thread runs or thread-safe
+ * mode is on. The lock is only taken when mem_locking is set, so
+ * single-threaded use pays nothing.
+ */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Non-zero while the API takes mem_lock: mem_thread_safe || mem_maint_running */
+static int mem_locking = 0;
+
+/** Set by mem_set_thread_safe */
+static int mem_thread_safe = 0;
+
+/** Non-zero while the maintenance thread runs */
+static int mem_maint_running = 0;
+
+/** Maintenance thread, valid while mem_maint_running is set */
+static pthread_t mem_maint_thread;
+
+/** Signalled to wake the maintenance thread early, or to stop it; uses CLOCK_MONOTONIC */
+static pthread_cond_t mem_maint_cond;
+
+/** Configuration the maintenance thread was started with */
+static MemMaintenanceConfig mem_maint_config;
+
+/** Set by mem_maintenance_stop to make the thread exit */
+static int mem_maint_stop = 0;
+
+/** Deferred frees since the last maintenance pass */
+static size_t mem_maint_frees = 0;
+
+/** Allocations that found their quick list empty, per size, since the last refill */
+static uint32_t mem_quick_misses[MEM_QUICK_BINS];
+
+/** Set when an allocation of that size tried its quick list since the last refill */
+static uint8_t mem_quick_used[MEM_QUICK_BINS];
+
+/** Blocks the maintenance thread keeps parked per size, left alone by its coalescing */
+static uint32_t mem_quick_target[MEM_QUICK_BINS];
+
+/** Allocation counter; the maintenance thread trims once it stops moving */
+static uint64_t mem_alloc_events = 0;
+
+/** Counters reported by mem_maintenance_stats */
+static MemMaintenanceStats mem_maint_stats;
+
+/**
+ * @brief Take mem_lock if the maintenance thread is running.
+ */
+static void lock_pool(void) {
+    if (mem_locking) pthread_mutex_lock(&mem_lock);
+}
+
+/**
+ * @brief Release mem_lock taken by lock_pool.
+ */
+static void unlock_pool(void) {
+    if (mem_locking) pthread_mutex_unlock(&mem_lock);
+}
+
+static void free_locked(MemPool* pool, void* ptr);
+static MemPool* loan_of(const MemPool* pool, const void* ptr);
+static void* loan_alloc(MemPool* pool, size_t size, int zeroed);
+static void loan_free(MemPool* loan, void* ptr);
+
+/**
+ * @brief Reserve the metadata arena for a pool of size bytes.
+ *
+ * Only the dirty-page bitmap is sized by the pool, at one bit per page;
+ * MAP_NORESERVE keeps it free until pages are actually marked. Node chunks
+ * are mapped by node_alloc as blocks are created.
+ *
+ * @return 0 on success, -1 if the reservation fails.
+ */
+static int meta_arena_reserve(size_t size) {
+    size_t pages = (size + mem_page_size - 1) / mem_page_size;
+    size_t bitmap_bytes = ((pages + 63) / 64 + 1) * sizeof(uint64_t);
+
+    void* arena = mmap(NULL, bitmap_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) return -1;
+
+    mem_meta_arena = arena;
+    mem_meta_size = bitmap_bytes;
+    mem_dirty_pages = (uint64_t*)mem_meta_arena;
+    mem_nodes = NULL;
+    mem_node_chunk_count = 0;
+    mem_node_capacity = 0;
+    mem_node_used = 0;
+    mem_node_free_list = NULL;
     return 0;
 }
 
+/**
+ * @brief Drop the metadata arena and every node chunk, and with them every MemBlock node.
+ */
+static void meta_arena_release(void) {
+    if (mem_meta_arena) munmap(mem_meta_arena, mem_meta_size);
+    for (size_t k = 0; k < mem_node_chunk_count; k++)
+        munmap(mem_node_chunks[k], ((size_t)MEM_META_FIRST_CHUNK << k) * sizeof(MemBlock));
+    mem_meta_arena = NULL;
+    mem_meta_size = 0;
+    mem_dirty_pages = NULL;
+    mem_node_chunk_count = 0;
+    mem_nodes = NULL;
+    mem_node_capacity = 0;
+    mem_node_used = 0;
+    mem_node_free_list = NULL;
+}
 
 /**
- * @brief Allocate a memory block of a given size from the memory pool.
+ * @brief Take a MemBlock node from the free list or the untouched end of the newest chunk.
  *
- * If size is 0, returns the first free block's address.
- * Otherwise, finds a free block large enough to satisfy the request.
- * If the block is larger than needed, splits it into allocated and free parts.
+ * When the newest chunk is used up, a chunk twice its size is mapped. Nodes
+ * never move, so pointers to them stay valid.
  *
- * @param size Size of the memory block to allocate in bytes.
- * @return Pointer to the allocated memory block, or NULL if allocation fails.
+ * @return The node, or NULL if no chunk could be mapped.
  */
-void* mem_alloc(size_t size) {
-    if (!mem_pool) return NULL;
+static MemBlock* node_alloc(void) {
+    MemBlock* node = mem_node_free_list;
+    if (node) {
+        mem_node_free_list = node->next;
+        return node;
+    }
+    if (mem_node_used == mem_node_capacity) {
+        if (mem_node_chunk_count == MEM_META_MAX_CHUNKS) return NULL;
+        size_t capacity = (size_t)MEM_META_FIRST_CHUNK << mem_node_chunk_count;
+        void* chunk = mmap(NULL, capacity * sizeof(MemBlock), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (chunk == MAP_FAILED) return NULL;
+        mem_node_chunks[mem_node_chunk_count++] = chunk;
+        mem_nodes = chunk;
+        mem_node_capacity = capacity;
+        mem_node_used = 0;
+    }
+    return &mem_nodes[mem_node_used++];
+}
 
-    if (size == 0) {
-        MemBlock* current_block = mem_block_list;
-        while (current_block){
-            if (current_block->is_block_free){
-                return mem_pool + current_block->offset;
-            }
-            current_block = current_block->next;
-        }
-        return NULL;
+/**
+ * @brief Return a MemBlock node to the node free list.
+ */
+static void node_free(MemBlock* node) {
+    node->next = mem_node_free_list;
+    mem_node_free_list = node;
+}
+
+/**
+ * @struct PrefaultSlice
+ * @brief Part of the pool one prefault thread touches.
+ */
+typedef struct {
+    char* start;
+    size_t length;
+    size_t page_size;
+} PrefaultSlice;
+
+/**
+ * @brief Fault in every page of a slice by writing a zero to it.
+ *
+ * Writing zero keeps the pages known-zero for mem_calloc while forcing the
+ * kernel to allocate and clear them now rather than on first use.
+ */
+static void* prefault_slice(void* arg) {
+    PrefaultSlice* slice = arg;
+    for (size_t offset = 0; offset < slice->length; offset += slice->page_size)
+        *(volatile char*)(slice->start + offset) = 0;
+    return NULL;
+}
+
+/**
+ * @brief Fault in the whole pool, splitting it into one page-aligned slice per thread.
+ *
+ * Each thread touches only its own slice, so the kernel's page clearing runs
+ * on all of them in parallel. Slices whose thread cannot be created are
+ * touched by the caller.
+ */
+static void prefault_pool(char* pool, size_t size, unsigned threads) {
+    size_t pages = (size + mem_page_size - 1) / mem_page_size;
+    if (threads > pages) threads = pages ? (unsigned)pages : 1;
+
+    PrefaultSlice* slices = calloc(threads, sizeof(PrefaultSlice));
+    pthread_t* tids = calloc(threads, sizeof(pthread_t));
+    int* started = calloc(threads, sizeof(int));
+    if (!slices || !tids || !started) {
+        PrefaultSlice whole = { pool, size, mem_page_size };
+        prefault_slice(&whole);
+        free(slices);
+        free(tids);
+        free(started);
+        return;
     }
 
-    MemBlock* current_block = mem_block_list;
+    size_t per_thread = pages / threads;
+    size_t extra = pages % threads;
+    size_t page = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t count = per_thread + (t < extra ? 1 : 0);
+        size_t offset = page * mem_page_size;
+        size_t end = (page + count) * mem_page_size;
+        slices[t] = (PrefaultSlice){ pool + offset, (end < size ? end : size) - offset, mem_page_size };
+        page += count;
+        // The calling thread takes the last slice itself
+        if (t + 1 < threads) started[t] = pthread_create(&tids[t], NULL, prefault_slice, &slices[t]) == 0;
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        if (!started[t]) prefault_slice(&slices[t]);
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+    free(slices);
+    free(tids);
+    free(started);
+}
 
-    while (current_block) {
-        if (current_block->is_block_free && current_block->size >= size) {
-            // If block is bigger than needed, split it
-            if (current_block->size > size) {
-                MemBlock* new_block = (MemBlock*)malloc(sizeof(MemBlock));
-                if (!new_block) return NULL;
-
-                new_block->offset = current_block->offset + size;
-                new_block->size = current_block->size - size;
-                new_block->is_block_free = 1;
-                new_block->next = current_block->next;
-
-                current_block->size = size;
-                current_block->is_block_free = 0;
-                current_block->next = new_block;
-            } else {
-                current_block->is_block_free = 0;  // Use entire block
-            }
+static int table_reserve(MemPool* pool);
+static void table_add(MemPool* pool, MemBlock* block);
+
+/**
+ * @brief Give an empty pool its first free block, covering all of it.
+ *
+ * @return 0 on success, -1 if the block table could not be allocated.
+ */
+static int pool_start(MemPool* pool) {
+    pool->table_enabled = pool->size <= UINT32_MAX;
+    if (table_reserve(pool) != 0) return -1;
+
+    MemBlock* block = node_alloc();
+    if (!block) return -1;
+    block->offset = 0;
+    block->size = pool->size;
+    block->is_block_free = 1;
+    block->next = NULL;
+    block->prev = NULL;
+    block->next_quick = NULL;
+    block->handle = 0;
+    pool->block_list = block;
+    table_add(pool, block);
+    return 0;
+}
+
+/**
+ * @brief Initialize the memory pool with a given size.
+ *
+ * Maps the memory pool and sets up the initial free block covering the entire pool.
+ * Every page starts out known to be zero.
+ *
+ * @param size Size of the memory pool to allocate in bytes.
+ * @return 0 on success, -1 on failure (e.g., already initialized or mmap failure).
+ */
+
+int mem_init(size_t size) {
+    return mem_init_ex(size, NULL, NULL);
+}
+
+/**
+ * @brief Initialize the memory pool, optionally prefaulting and locking it.
+ *
+ * With prefault_threads set, the pool is faulted in by that many threads up
+ * front, so no request later stalls on a first-touch page fault. With
+ * lock_pages set, the pool is then mlock'ed so it is never paged out (this
+ * needs a large enough RLIMIT_MEMLOCK). Locked pages cannot be decommitted,
+ * so mem_trim leaves them alone.
+ *
+ * With backing_file set, the pool is a shared mapping of that file, so a pool
+ * larger than RAM pages out to the file instead of to swap. The file must be
+ * new or empty, so an existing file's data is never truncated away; it is
+ * grown sparse to size and left for the caller to remove.
+ * Block metadata stays in anonymous node chunks outside the pool, so
+ * allocating and freeing never fault in pool pages.
+ *
+ * @param size Size of the memory pool to allocate in bytes.
+ * @param options Prefault and locking options; NULL behaves like mem_init.
+ * @param report If not NULL, receives the process page-fault counts before
+ *        and after the prefault and how long it took.
+ * @return 0 on success, -1 on failure (already initialized, a non-empty
+ *         backing file, mmap or mlock failure).
+ */
+int mem_init_ex(size_t size, const MemInitOptions* options, MemInitReport* report) {
+    if (mem_root.base != NULL) return -1;
+    if (report) memset(report, 0, sizeof(*report));
 
-            return mem_pool + current_block->offset;
+    // Anonymous mappings and files grown from empty start out zeroed, which
+    // mem_calloc relies on. Only address space is reserved; pages are
+    // committed when first touched, and a file gets disk blocks when written.
+    mem_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    int fd = -1;
+    if (options && options->backing_file) {
+        fd = open(options->backing_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size != 0 || ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            return -1;
         }
+    }
+    void* pool = fd >= 0 ? mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0)
+                         : mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pool == MAP_FAILED || meta_arena_reserve(size) != 0) {
+        if (pool != MAP_FAILED) munmap(pool, size ? size : 1);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
 
-        current_block = current_block->next;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    if (report) {
+        report->minor_faults_before = usage.ru_minflt;
+        report->major_faults_before = usage.ru_majflt;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (options && options->prefault_threads && size) prefault_pool(pool, size, options->prefault_threads);
+    if (options && options->lock_pages && mlock(pool, size ? size : 1) != 0) {
+        munmap(pool, size ? size : 1);
+        if (fd >= 0) close(fd);
+        meta_arena_release();
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &usage);
+    if (report) {
+        report->minor_faults_after = usage.ru_minflt;
+        report->major_faults_after = usage.ru_majflt;
+        report->prefault_ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+        report->locked = options && options->lock_pages;
     }
 
-    return NULL;  // No suitable block found
+    memset(&mem_root, 0, sizeof(mem_root));
+    mem_root.base = pool;
+    mem_root.size = size;
+
+    // Setup initial free block covering entire pool
+    if (pool_start(&mem_root) != 0) {
+        munmap(pool, size ? size : 1);
+        if (fd >= 0) close(fd);
+        meta_arena_release();
+        memset(&mem_root, 0, sizeof(mem_root));
+        return -1;
+    }
+    mem_pool_fd = fd;
+    mem_tcache_generation++;
+    return 0;
 }
 
+
 /**
- * @brief Free a previously allocated memory block.
+ * @brief Select the placement policy used by mem_alloc.
  *
- * Marks the block as free and merges with adjacent free blocks if possible.
+ * The policy may be changed at any time; it only affects future allocations.
  *
- * @param ptr Pointer to the memory block to free.
+ * @param policy One of the MemPolicy values.
+ * @return 0 on success, -1 if the policy is unknown.
  */
-void mem_free(void* ptr) {
-    if (!ptr || !mem_pool) return;
+int mem_set_policy(MemPolicy policy) {
+    switch (policy) {
+    case MEM_POLICY_FIRST_FIT:
+    case MEM_POLICY_NEXT_FIT:
+    case MEM_POLICY_BEST_FIT:
+        mem_policy = policy;
+        mem_root.next_fit_offset = 0;
+        return 0;
+    }
+    return -1;
+}
 
-    size_t offset = (char*)ptr - mem_pool;
-    MemBlock* current_block = mem_block_list;
-    MemBlock* previous_block = NULL;
+/**
+ * @brief Make room for one more entry in the block table, growing it if needed.
+ *
+ * Called before a block is created so a split can fail cleanly.
+ *
+ * @return 0 on success, -1 if the table could not be grown.
+ */
+static int table_reserve(MemPool* pool) {
+    if (!pool->table_enabled || pool->table_count < pool->table_capacity) return 0;
 
-    while (current_block) {
-        if (current_block->offset == offset) {
-            if (current_block->is_block_free) return;  // Already free
+    size_t capacity = pool->table_capacity ? pool->table_capacity * 2 : 64;
+    uint32_t* offsets = realloc(pool->table_offset, capacity * sizeof(uint32_t));
+    if (offsets) pool->table_offset = offsets;
+    uint32_t* fits = realloc(pool->table_fit, capacity * sizeof(uint32_t));
+    if (fits) pool->table_fit = fits;
+    MemBlock** blocks = realloc(pool->table_block, capacity * sizeof(MemBlock*));
+    if (blocks) pool->table_block = blocks;
+    if (!offsets || !fits || !blocks) return -1;
 
-            current_block->is_block_free = 1;
+    pool->table_capacity = capacity;
+    return 0;
+}
 
-            // Merge with next block if it is free
-            if (current_block->next && current_block->next->is_block_free) {
-                MemBlock* next_block = current_block->next;
-                current_block->size += next_block->size;
-                current_block->next = next_block->next;
-                free(next_block);
-            }
+/**
+ * @brief Copy a block's offset, size and state into its block table entry.
+ *
+ * Called after every change to a block's offset, size or free flag.
+ */
+static void table_sync(MemPool* pool, MemBlock* block) {
+    if (!pool->table_enabled) return;
+    pool->table_offset[block->table_slot] = (uint32_t)block->offset;
+    pool->table_fit[block->table_slot] = block->is_block_free == 1 ? (uint32_t)block->size : 0;
+}
 
-            // Merge with previous block if it is free
-            if (previous_block && previous_block->is_block_free) {
-                previous_block->size += current_block->size;
-                previous_block->next = current_block->next;
-                free(current_block);
-            }
+/**
+ * @brief Append an entry for a new block; table_reserve made room for it.
+ */
+static void table_add(MemPool* pool, MemBlock* block) {
+    if (!pool->table_enabled) return;
+    block->table_slot = (uint32_t)pool->table_count++;
+    pool->table_block[block->table_slot] = block;
+    table_sync(pool, block);
+}
 
-            return;
+/**
+ * @brief Drop a block's entry; the last entry moves into its slot.
+ */
+static void table_remove(MemPool* pool, MemBlock* block) {
+    if (!pool->table_enabled) return;
+    size_t last = --pool->table_count;
+    if (block->table_slot != last) {
+        MemBlock* moved = pool->table_block[last];
+        moved->table_slot = block->table_slot;
+        pool->table_block[moved->table_slot] = moved;
+        table_sync(pool, moved);
+    }
+}
+
+/**
+ * GCC's default -O2 cost model refuses to vectorize the block table scans
+ * (unsigned compares and minimums need a few extra SSE2 instructions); the
+ * cheap model accepts them.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define MEM_VECTORIZE __attribute__((optimize("vect-cost-model=cheap")))
+#else
+#define MEM_VECTORIZE
+#endif
+
+/** Entries per run of the block table minimum, see table_lowest */
+#define MEM_TABLE_RUN 128
+
+/**
+ * @brief Lowest key among count entries, where an entry's key is its offset
+ *        shifted down by base (wrapping) if its fit is at least need (exact = 0)
+ *        or exactly need (exact = 1), and UINT32_MAX otherwise.
+ *
+ * The loop is a branch-free minimum over two contiguous uint32_t arrays, which
+ * the compiler vectorizes. found is set non-zero if any entry qualifies.
+ */
+MEM_VECTORIZE
+static uint32_t table_run_lowest(const uint32_t* offsets, const uint32_t* fits, size_t count,
+                                 uint32_t need, uint32_t base, int exact, uint32_t* found) {
+    uint32_t lowest = UINT32_MAX, any = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t mask = 0u - (uint32_t)(exact ? fits[i] == need : fits[i] >= need);
+        uint32_t key = ((offsets[i] - base) & mask) | ~mask;
+        lowest = key < lowest ? key : lowest;
+        any |= mask;
+    }
+    *found = any;
+    return lowest;
+}
+
+/**
+ * @brief Slot of the entry with the lowest offset among those whose fit is at
+ *        least need (exact = 0) or exactly need (exact = 1).
+ *
+ * Offsets are shifted down by base first (wrapping), so next fit can ask for
+ * the first candidate at or after its cursor. The table is reduced in runs of
+ * MEM_TABLE_RUN entries, remembering which run holds the minimum, and only that
+ * run is scanned again for the slot, never the whole table.
+ *
+ * @return The slot, or -1 if no entry qualifies.
+ */
+MEM_VECTORIZE
+static int64_t table_lowest(const MemPool* pool, uint32_t need, uint32_t base, int exact) {
+    const size_t count = pool->table_count;
+    uint32_t lowest = UINT32_MAX;
+    size_t best = SIZE_MAX;
+
+    for (size_t run = 0; run < count; run += MEM_TABLE_RUN) {
+        size_t length = count - run < MEM_TABLE_RUN ? count - run : MEM_TABLE_RUN;
+        uint32_t found;
+        uint32_t key = table_run_lowest(pool->table_offset + run, pool->table_fit + run, length,
+                                        need, base, exact, &found);
+        if (found && (best == SIZE_MAX || key < lowest)) {
+            lowest = key;
+            best = run;
         }
+    }
+    if (best == SIZE_MAX) return -1;
 
-        previous_block = current_block;
-        current_block = current_block->next;
+    size_t end = count - best < MEM_TABLE_RUN ? count : best + MEM_TABLE_RUN;
+    for (size_t i = best; i < end; i++) {
+        uint32_t fit = pool->table_fit[i];
+        if (pool->table_offset[i] - base == lowest && (exact ? fit == need : fit >= need)) return (int64_t)i;
     }
+    return -1;
 }
 
+/**
+ * @brief Smallest fit of at least need in the block table, or 0 if none.
+ */
+MEM_VECTORIZE
+static uint32_t table_smallest(const MemPool* pool, uint32_t need) {
+    const uint32_t* fits = pool->table_fit;
+    const size_t count = pool->table_count;
+    uint32_t smallest = UINT32_MAX, found = 0;
 
-// Resize an allocated memory block to a new size
-void* mem_resize(void* ptr, size_t size) {
-    if (!ptr) return mem_alloc(size);
-    if (size == 0) {
-        mem_free(ptr);
-        return NULL;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t mask = 0u - (uint32_t)(fits[i] >= need);
+        uint32_t key = (fits[i] & mask) | ~mask;
+        smallest = key < smallest ? key : smallest;
+        found |= mask;
+    }
+    return found ? smallest : 0;
+}
+
+/**
+ * @brief find_free_block over the block table instead of the block list.
+ *
+ * First fit takes the lowest fitting offset and next fit the lowest at or
+ * after the cursor, wrapping. Best fit first finds the smallest fitting size,
+ * then the lowest offset among blocks of exactly that size, so ties go to the
+ * lowest address just like the list walk. The search yields the entry's slot,
+ * so the block comes straight from table_block; every pass streams through
+ * contiguous arrays instead of chasing list pointers through the node arena.
+ *
+ * @return The chosen block, or NULL if no free block is large enough.
+ */
+static MemBlock* table_find(MemPool* pool, size_t size) {
+    if (size > UINT32_MAX) return NULL;
+
+    uint32_t need = (uint32_t)size;
+    int64_t slot;
+    switch (mem_policy) {
+    case MEM_POLICY_NEXT_FIT:
+        slot = table_lowest(pool, need, (uint32_t)pool->next_fit_offset, 0);
+        break;
+    case MEM_POLICY_BEST_FIT:
+        need = table_smallest(pool, need);
+        slot = need ? table_lowest(pool, need, 0, 1) : -1;
+        break;
+    default:
+        slot = table_lowest(pool, need, 0, 0);
+        break;
     }
+    return slot < 0 ? NULL : pool->table_block[slot];
+}
+
+/**
+ * @brief Find a free block of at least size bytes according to mem_policy.
+ *
+ * First fit returns the lowest-addressed candidate. Next fit returns the first
+ * candidate at or after the pool's next_fit_offset, wrapping to the lowest candidate.
+ * Best fit returns the smallest candidate, stopping early on an exact fit.
+ * Pools with a block table scan it instead of walking the list.
+ *
+ * @param size Requested size in bytes (non-zero).
+ * @return The chosen block, or NULL if no free block is large enough.
+ */
+static MemBlock* find_free_block(MemPool* pool, size_t size) {
+    if (pool->table_enabled) return table_find(pool, size);
 
-    size_t offset = (char*)ptr - mem_pool;
-    MemBlock* current_block = mem_block_list;
+    MemBlock* first_fit = NULL;
+    MemBlock* current_block = pool->block_list;
 
     while (current_block) {
-        if (current_block->offset == offset) {
-            if (current_block->size >= size) {
-                if (current_block->size > size) {
-                    // Split the block
-                    MemBlock* new_block = (MemBlock*)malloc(sizeof(MemBlock));
-                    if (!new_block) return NULL;
-
-                    new_block->offset = current_block->offset + size;
-                    new_block->size = current_block->size - size;
-                    new_block->is_block_free = 1;
-                    new_block->next = current_block->next;
-
-                    current_block->size = size;
-                    current_block->next = new_block;
-                }
-                return ptr;
-            } else {
-                // Try to merge with next if possible
-                if (current_block->next && current_block->next->is_block_free &&
-                    current_block->size + current_block->next->size >= size) {
-                    current_block->size += current_block->next->size;
-                    MemBlock* next_block = current_block->next;
-                    current_block->next = next_block->next;
-                    free(next_block);
-
-                    // Split again if oversized
-                    if (current_block->size > size) {
-                        MemBlock* new_block = (MemBlock*)malloc(sizeof(MemBlock));
-                        if (!new_block) return NULL;
-
-                        new_block->offset = current_block->offset + size;
-                        new_block->size = current_block->size - size;
-                        new_block->is_block_free = 1;
-                        new_block->next = current_block->next;
-
-                        current_block->size = size;
-                        current_block->next = new_block;
-                    }
-
-                    return ptr;
-                } else {
-                    // Fallback: allocate new, copy data
-                    void* new_ptr = mem_alloc(size);
-                    if (new_ptr) {
-                        memcpy(new_ptr, ptr, current_block->size);
-                        mem_free(ptr);
-                    }
-                    return new_ptr;
-                }
+        if (current_block->is_block_free == 1 && current_block->size >= size) {
+            switch (mem_policy) {
+            case MEM_POLICY_FIRST_FIT:
+                return current_block;
+            case MEM_POLICY_NEXT_FIT:
+                if (current_block->offset >= pool->next_fit_offset) return current_block;
+                if (!first_fit) first_fit = current_block;
+                break;
+            case MEM_POLICY_BEST_FIT:
+                if (current_block->size == size) return current_block;
+                if (!first_fit || current_block->size < first_fit->size) first_fit = current_block;
+                break;
             }
         }
-
         current_block = current_block->next;
     }
 
-    return NULL;
+    return first_fit;
 }
 
-// Deinitialize memory pool, releasing all memory
-void mem_deinit() {
-    if (mem_pool) {
-        free(mem_pool);
-        mem_pool = NULL;
-        mem_pool_size = 0;
-    }
+/**
+ * @brief Record that the pages overlapping [offset, offset + size) may be non-zero.
+ */
+static void mark_dirty(MemPool* pool, size_t offset, size_t size) {
+    if (size == 0) return;
+    offset += pool->root_offset;
+    size_t first = offset / mem_page_size;
+    size_t last = (offset + size - 1) / mem_page_size;
+    for (size_t page = first; page <= last; page++)
+        mem_dirty_pages[page / 64] |= (uint64_t)1 << (page % 64);
+}
 
-    MemBlock* current_block = mem_block_list;
-    while (current_block) {
-        MemBlock* next_block = current_block->next;
-        free(current_block);
-        current_block = next_block;
+/**
+ * @brief Zero [offset, offset + size), skipping pages known to be zero.
+ */
+static void zero_range(MemPool* pool, size_t offset, size_t size) {
+    char* base = pool->base - pool->root_offset;  // Pages are numbered from the global pool
+    offset += pool->root_offset;
+    size_t end = offset + size;
+    while (offset < end) {
+        size_t page = offset / mem_page_size;
+        size_t page_end = (page + 1) * mem_page_size;
+        size_t chunk = (page_end < end ? page_end : end) - offset;
+        if (mem_dirty_pages[page / 64] & ((uint64_t)1 << (page % 64)))
+            memset(base + offset, 0, chunk);
+        offset += chunk;
     }
+}
+
+/** Home slot of an offset in the pool's block index (Fibonacci hashing) */
+static size_t index_home(MemPool* pool, size_t offset) {
+    return (size_t)(((uint64_t)offset * 0x9E3779B97F4A7C15ull) >> 32) & (pool->index_capacity - 1);
+}
 
-    mem_block_list = NULL;
+/**
+ * @brief Find the allocated or deferred block that starts at offset.
+ *
+ * @return The block, or NULL if no such block is indexed.
+ */
+static MemBlock* index_find(MemPool* pool, size_t offset) {
+    if (!pool->index_capacity) return NULL;
+    for (size_t slot = index_home(pool, offset);; slot = (slot + 1) & (pool->index_capacity - 1)) {
+        MemBlock* block = pool->block_index[slot];
+        if (!block) return NULL;
+        if (block->offset == offset) return block;
+    }
+}
+
+static void index_insert(MemPool* pool, MemBlock* block) {
+    size_t slot = index_home(pool, block->offset);
+    while (pool->block_index[slot]) slot = (slot + 1) & (pool->index_capacity - 1);
+    pool->block_index[slot] = block;
+    pool->index_count++;
+}
+
+/**
+ * @brief Make room for one more block in the index, growing it if needed.
+ *
+ * Called before any list mutation so an allocation can fail cleanly.
+ *
+ * @return 0 on success, -1 if the table could not be grown.
+ */
+static int index_reserve(MemPool* pool) {
+    if ((pool->index_count + 1) * 2 <= pool->index_capacity) return 0;
+
+    size_t old_capacity = pool->index_capacity;
+    MemBlock** old_table = pool->block_index;
+    size_t capacity = old_capacity ? old_capacity * 2 : 64;
+    MemBlock** table = calloc(capacity, sizeof(MemBlock*));
+    if (!table) return -1;
+
+    pool->block_index = table;
+    pool->index_capacity = capacity;
+    pool->index_count = 0;
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old_table[i]) index_insert(pool, old_table[i]);
+    free(old_table);
+    return 0;
+}
+
+/**
+ * @brief Remove block from the index.
+ *
+ * Uses backward-shift deletion so probe chains stay intact without tombstones.
+ */
+static void index_remove(MemPool* pool, MemBlock* block) {
+    size_t mask = pool->index_capacity - 1;
+    size_t hole = index_home(pool, block->offset);
+    while (pool->block_index[hole] != block) hole = (hole + 1) & mask;
+
+    for (size_t slot = (hole + 1) & mask; pool->block_index[slot]; slot = (slot + 1) & mask) {
+        size_t home = index_home(pool, pool->block_index[slot]->offset);
+        // Move the entry back unless its home lies cyclically in (hole, slot]
+        int stays = hole <= slot ? (home > hole && home <= slot) : (home > hole || home <= slot);
+        if (!stays) {
+            pool->block_index[hole] = pool->block_index[slot];
+            hole = slot;
+        }
+    }
+    pool->block_index[hole] = NULL;
+    pool->index_count--;
+}
+
+/**
+ * @brief Absorb the block following block into it and release its MemBlock.
+ */
+static void merge_next(MemPool* pool, MemBlock* block) {
+    MemBlock* next_block = block->next;
+    block->size += next_block->size;
+    block->next = next_block->next;
+    if (block->next) block->next->prev = block;
+    table_remove(pool, next_block);
+    table_sync(pool, block);
+    node_free(next_block);
+}
+
+/**
+ * @brief Round a request up to the configured alignment quantum.
+ *
+ * @return The rounded size, or 0 if rounding overflows.
+ */
+static size_t align_request(size_t size) {
+    size_t mask = mem_frag_policy.alignment - 1;
+    if (size > SIZE_MAX - mask) return 0;
+    return (size + mask) & ~mask;
+}
+
+/**
+ * @brief Round a request up to its size class and alignment quantum.
+ *
+ * Size classes are spaced four per power of two (16, 20, 24, 28, 32, 40, ...),
+ * so the rounding wastes at most a quarter of a block while letting blocks of
+ * neighbouring sizes be reused for each other.
+ *
+ * @return The rounded size, or 0 if rounding overflows.
+ */
+static size_t round_request(size_t size) {
+    if (mem_frag_policy.size_classes) {
+        if (size <= 16) {
+            size = 16;
+        } else {
+            int log2 = 63 - __builtin_clzll((unsigned long long)(size - 1));
+            size_t step = (size_t)1 << (log2 - 2);
+            if (size > SIZE_MAX - step) return 0;
+            size = (size + step - 1) & ~(step - 1);
+        }
+    }
+    return align_request(size);
+}
+
+/**
+ * @brief Select the split threshold, size-class rounding and alignment quantum.
+ *
+ * Only future requests are affected. Block offsets are multiples of the
+ * alignment quantum as long as it is set before the first allocation.
+ *
+ * @param policy New policy, or NULL to restore the defaults (no rounding, always split).
+ * @return 0 on success, -1 if the alignment is not a power of two.
+ */
+int mem_set_frag_policy(const MemFragPolicy* policy) {
+    MemFragPolicy defaults = { 0, 1, 0 };
+    if (!policy) policy = &defaults;
+
+    size_t alignment = policy->alignment ? policy->alignment : 1;
+    if (alignment & (alignment - 1)) return -1;
+
+    mem_frag_policy = *policy;
+    mem_frag_policy.alignment = alignment;
+    return 0;
+}
+
+/**
+ * @brief Split block so that it keeps exactly size bytes.
+ *
+ * The remainder becomes a new free block inserted right after it. The caller
+ * guarantees block->size > size.
+ *
+ * @return The new free remainder, or NULL if its MemBlock could not be allocated.
+ */
+static MemBlock* split_block(MemPool* pool, MemBlock* block, size_t size) {
+    if (table_reserve(pool) != 0) return NULL;
+    MemBlock* new_block = node_alloc();
+    if (!new_block) return NULL;
+
+    new_block->offset = block->offset + size;
+    new_block->size = block->size - size;
+    new_block->is_block_free = 1;
+    new_block->next = block->next;
+    new_block->prev = block;
+    new_block->next_quick = NULL;
+    new_block->handle = 0;
+    if (new_block->next) new_block->next->prev = new_block;
+
+    block->size = size;
+    block->next = new_block;
+    table_add(pool, new_block);
+    table_sync(pool, block);
+    return new_block;
+}
+
+/**
+ * @brief Shrink block to size bytes unless the remainder would be a sliver.
+ *
+ * Remainders smaller than the policy's min_split stay inside the block as
+ * slack (visible through mem_usable_size) rather than becoming tiny free
+ * blocks that lengthen the list. A remainder cut from an allocated block
+ * (mem_resize shrinking it) may touch a free block and is merged with it.
+ *
+ * @return 0 on success, -1 if a needed split failed.
+ */
+static int trim_block(MemPool* pool, MemBlock* block, size_t size) {
+    size_t remainder = block->size - size;
+    if (remainder == 0 || remainder < mem_frag_policy.min_split) return 0;
+
+    MemBlock* rest = split_block(pool, block, size);
+    if (!rest) return -1;
+    if (rest->next && rest->next->is_block_free == 1) merge_next(pool, rest);
+    return 0;
+}
+
+/**
+ * @brief Hand out block: clear it for mem_calloc and record its pages as dirty.
+ */
+static void* hand_out(MemPool* pool, MemBlock* block, size_t size, int zeroed) {
+    if (zeroed) zero_range(pool, block->offset, size);
+    mark_dirty(pool, block->offset, block->size);
+    return pool->base + block->offset;
+}
+
+/**
+ * @brief Merge deferred blocks back into the block list, keeping some parked.
+ *
+ * Quick lists are cut after keep[size] blocks (all of them go when keep is
+ * NULL), then a single pass over the block list merges each run of adjacent
+ * free blocks into one.
+ */
+static void coalesce_quick(MemPool* pool, const uint32_t* keep) {
+    if (pool->deferred_count == 0) return;
+
+    for (size_t i = 0; i < MEM_QUICK_BINS; i++) {
+        MemBlock** link = &pool->quick_bins[i];
+        for (uint32_t kept = 0; *link && keep && kept < keep[i]; kept++) link = &(*link)->next_quick;
+        for (MemBlock* quick = *link; quick; quick = quick->next_quick) {
+            index_remove(pool, quick);
+            quick->is_block_free = 1;
+            table_sync(pool, quick);
+            pool->deferred_count--;
+        }
+        *link = NULL;
+    }
+
+    MemBlock* current_block = pool->block_list;
+    while (current_block) {
+        MemBlock* next_block = current_block->next;
+        if (current_block->is_block_free == 1 && next_block && next_block->is_block_free == 1) {
+            merge_next(pool, current_block);
+            continue;
+        }
+        current_block = next_block;
+    }
+}
+
+/**
+ * @brief Merge every deferred block back into the block list.
+ */
+static void coalesce_deferred(MemPool* pool) {
+    coalesce_quick(pool, NULL);
+}
+
+/**
+ * @brief Merge every deferred block back into the block list now.
+ */
+void mem_coalesce(void) {
+    lock_pool();
+    coalesce_deferred(&mem_root);
+    unlock_pool();
+}
+
+/**
+ * @brief Choose between eager and deferred coalescing.
+ *
+ * In deferred mode mem_free parks blocks smaller than MEM_QUICK_BINS bytes on
+ * quick lists by exact size; larger blocks still merge eagerly. An allocation
+ * of the same size reuses them without splitting. They are merged in one batch
+ * when an allocation cannot be satisfied, or once threshold blocks are pending.
+ * Switching back to eager mode merges any pending blocks.
+ *
+ * @param mode MEM_COALESCE_EAGER or MEM_COALESCE_DEFERRED.
+ * @param threshold Pending blocks that trigger a batch merge; 0 merges only on failure.
+ * @return 0 on success, -1 if the mode is unknown.
+ */
+int mem_set_coalescing(MemCoalesceMode mode, size_t threshold) {
+    if (mode != MEM_COALESCE_EAGER && mode != MEM_COALESCE_DEFERRED) return -1;
+
+    lock_pool();
+    mem_coalesce_mode = mode;
+    mem_coalesce_threshold = threshold;
+    if (mode == MEM_COALESCE_EAGER) coalesce_deferred(&mem_root);
+    unlock_pool();
+    return 0;
+}
+
+/**
+ * @brief Pop a deferred block of exactly size bytes from the quick lists.
+ *
+ * @return The block, now marked allocated, or NULL if none is parked.
+ */
+static MemBlock* quick_pop(MemPool* pool, size_t size) {
+    if (size >= MEM_QUICK_BINS) return NULL;
+    // Only the global pool's quick lists are refilled by the maintenance thread
+    int tracked = mem_maint_config.refill && pool == &mem_root;
+    if (tracked) mem_quick_used[size] = 1;
+    if (!pool->quick_bins[size]) {
+        if (tracked && mem_quick_misses[size] < UINT32_MAX) mem_quick_misses[size]++;
+        return NULL;
+    }
+
+    MemBlock* block = pool->quick_bins[size];
+    pool->quick_bins[size] = block->next_quick;
+    block->next_quick = NULL;
+    block->is_block_free = 0;
+    pool->deferred_count--;
+    return block;
+}
+
+/**
+ * @brief Put a block on its quick list without any further bookkeeping.
+ */
+static void quick_park(MemPool* pool, MemBlock* block) {
+    block->is_block_free = MEM_BLOCK_DEFERRED;
+    table_sync(pool, block);
+    block->next_quick = pool->quick_bins[block->size];
+    pool->quick_bins[block->size] = block;
+    pool->deferred_count++;
+}
+
+/**
+ * @brief Park a freed block on its quick list instead of merging it.
+ *
+ * Wakes the maintenance thread once enough frees have piled up, and merges
+ * inline once the coalescing threshold is reached.
+ */
+static void quick_push(MemPool* pool, MemBlock* block) {
+    quick_park(pool, block);
+
+    if (mem_maint_running && mem_maint_config.wake_frees && ++mem_maint_frees == mem_maint_config.wake_frees)
+        pthread_cond_signal(&mem_maint_cond);
+    if (mem_coalesce_threshold && pool->deferred_count >= mem_coalesce_threshold) coalesce_deferred(pool);
+}
+
+/**
+ * @brief Take an allocated block of at least size bytes from the block list.
+ *
+ * Finds a free block large enough to satisfy the request using the current
+ * placement policy (see mem_set_policy). If the block is larger than needed,
+ * splits it into allocated and free parts. The caller rounds size first.
+ *
+ * @param size Rounded, non-zero size in bytes.
+ * @return The block, now allocated and indexed, or NULL if allocation fails.
+ */
+static MemBlock* block_take(MemPool* pool, size_t size) {
+    if (pool->deferred_count || mem_maint_config.refill) {
+        MemBlock* quick_block = quick_pop(pool, size);
+        if (quick_block) return quick_block;
+    }
+
+    if (index_reserve(pool) != 0) return NULL;
+
+    MemBlock* current_block = find_free_block(pool, size);
+    if (!current_block && pool->deferred_count) {
+        // Deferred blocks may merge into a large enough block
+        coalesce_deferred(pool);
+        current_block = find_free_block(pool, size);
+    }
+    if (!current_block) return NULL;  // No suitable block found
+
+    // If block is bigger than needed, split it
+    if (trim_block(pool, current_block, size) != 0) return NULL;
+    current_block->is_block_free = 0;
+    table_sync(pool, current_block);
+    index_insert(pool, current_block);
+
+    pool->next_fit_offset = current_block->offset + current_block->size;
+    return current_block;
+}
+
+/**
+ * @brief Allocate a block of a given size from the block list.
+ *
+ * If size is 0, returns the first free block's address.
+ * Otherwise the size is rounded according to the fragmentation policy and
+ * the block comes from block_take.
+ *
+ * @param size Size of the memory block to allocate in bytes.
+ * @param zeroed Non-zero to clear the block (mem_calloc).
+ * @return Pointer to the allocated memory block, or NULL if allocation fails.
+ */
+static void* block_alloc(MemPool* pool, size_t size, int zeroed) {
+    if (size == 0) {
+        MemBlock* current_block = pool->block_list;
+        while (current_block){
+            if (current_block->is_block_free == 1){
+                return pool->base + current_block->offset;
+            }
+            current_block = current_block->next;
+        }
+        return NULL;
+    }
+
+    size = round_request(size);
+    if (size == 0) return NULL;
+
+    MemBlock* block = block_take(pool, size);
+    return block ? hand_out(pool, block, size, zeroed) : NULL;
+}
+
+/**
+ * @brief Bump-allocate size bytes from the innermost open region.
+ *
+ * The size is rounded to the alignment quantum so the next bump stays aligned.
+ * The start is recorded in mem_region_starts.
+ *
+ * @param zeroed Non-zero to clear the allocation (mem_calloc).
+ * @return Pointer to the allocation, or NULL if the region extent is full.
+ */
+static void* region_alloc(size_t size, int zeroed) {
+    size_t end = mem_region_block->offset + mem_region_block->size;
+    size = align_request(size);
+    if (size > end - mem_region_top) return NULL;
+    if (size == 0) return mem_root.base + mem_region_top;  // Like mem_alloc(0): nothing is taken
+
+    if (mem_region_count == mem_region_capacity) {
+        size_t capacity = mem_region_capacity ? mem_region_capacity * 2 : 64;
+        size_t* starts = realloc(mem_region_starts, capacity * sizeof(size_t));
+        if (!starts) return NULL;
+        mem_region_starts = starts;
+        mem_region_capacity = capacity;
+    }
+
+    size_t offset = mem_region_top;
+    mem_region_starts[mem_region_count++] = offset;
+    mem_region_top += size;
+    if (zeroed) zero_range(&mem_root, offset, size);
+    mark_dirty(&mem_root, offset, size);
+    return mem_root.base + offset;
+}
+
+/**
+ * @brief Carve the small-block region from the global pool on the first small request.
+ *
+ * The extent is one block marked MEM_BLOCK_SMALL, so mem_free and mem_compact
+ * leave it alone. Its bitmaps live outside the pool, like the block index.
+ *
+ * @return 0 if the region is ready, -1 if it could not be set up.
+ */
+static int small_reserve(void) {
+    if (mem_small_block) return 0;
+    if (mem_small_unavailable) return -1;
+
+    size_t granule = mem_small_config.granule;
+    size_t granules = mem_small_config.region_size / granule;
+    size_t words = (granules + 63) / 64;
+    uint64_t* free_bits = calloc(words, sizeof(uint64_t));
+    uint64_t* end_bits = calloc(words, sizeof(uint64_t));
+    size_t size = round_request(granules * granule + granule - 1);  // Room to align the start
+    MemBlock* block = free_bits && end_bits && granules && size ? block_take(&mem_root, size) : NULL;
+    if (!block) {
+        free(free_bits);
+        free(end_bits);
+        mem_small_unavailable = 1;
+        return -1;
+    }
+    block->is_block_free = MEM_BLOCK_SMALL;
+
+    for (size_t w = 0; w < words; w++) {
+        size_t valid = granules - w * 64;
+        free_bits[w] = valid >= 64 ? UINT64_MAX : ((uint64_t)1 << valid) - 1;
+    }
+    mem_small_block = block;
+    mem_small_start = (block->offset + granule - 1) & ~(granule - 1);
+    mem_small_end = mem_small_start + granules * granule;
+    mem_small_shift = (unsigned)__builtin_ctzll((unsigned long long)granule);
+    mem_small_free = free_bits;
+    mem_small_ends = end_bits;
+    mem_small_words = words;
+    mem_small_hint = 0;
+    mem_small_used = 0;
+    return 0;
+}
+
+/**
+ * @brief Give the small-block region's extent back to the pool and drop its bitmaps.
+ *
+ * @param return_extent Non-zero to free the extent, 0 when the pool is going away.
+ */
+static void small_release(int return_extent) {
+    MemBlock* block = mem_small_block;
+    mem_small_block = NULL;  // Detach first so free_locked treats the extent as a plain block
+    if (block && return_extent) {
+        block->is_block_free = 0;
+        free_locked(&mem_root, mem_root.base + block->offset);
+    }
+    free(mem_small_free);
+    free(mem_small_ends);
+    mem_small_free = NULL;
+    mem_small_ends = NULL;
+    mem_small_words = 0;
+    mem_small_used = 0;
+    mem_small_unavailable = 0;
+}
+
+/**
+ * @brief Positions in a word where a run of count set bits starts.
+ *
+ * Bit i of the result is set iff bits i .. i + count - 1 of bits are all set.
+ * The run length covered doubles each step, so this takes log2(count) steps.
+ */
+static uint64_t run_starts(uint64_t bits, unsigned count) {
+    for (unsigned covered = 1; covered < count && bits;) {
+        unsigned shift = covered < count - covered ? covered : count - covered;
+        bits &= bits >> shift;
+        covered += shift;
+    }
+    return bits;
+}
+
+/**
+ * @brief Allocate size bytes (at most 64 granules) from the small-block region.
+ *
+ * Searches the free bitmap one word at a time, starting at the word that
+ * satisfied the previous request: words with no free granule are skipped
+ * with one compare, and the lowest run of enough free granules in a word is
+ * found with run_starts and __builtin_ctzll. Runs never straddle two words.
+ *
+ * @return Pointer to the allocation, or NULL if no run is free.
+ */
+static void* small_alloc(size_t size, int zeroed) {
+    if (small_reserve() != 0) return NULL;
+
+    unsigned count = (unsigned)((size + ((size_t)1 << mem_small_shift) - 1) >> mem_small_shift);
+    uint64_t run = count == 64 ? UINT64_MAX : ((uint64_t)1 << count) - 1;
+    for (size_t k = 0; k < mem_small_words; k++) {
+        size_t word = mem_small_hint + k < mem_small_words ? mem_small_hint + k : mem_small_hint + k - mem_small_words;
+        if (!mem_small_free[word]) continue;
+        uint64_t starts = run_starts(mem_small_free[word], count);
+        if (!starts) continue;
+
+        unsigned bit = (unsigned)__builtin_ctzll(starts);
+        mem_small_free[word] &= ~(run << bit);
+        mem_small_ends[word] |= (uint64_t)1 << (bit + count - 1);
+        mem_small_hint = word;
+        mem_small_used += count;
+
+        size_t offset = mem_small_start + ((word * 64 + bit) << mem_small_shift);
+        size_t bytes = (size_t)count << mem_small_shift;
+        if (zeroed) zero_range(&mem_root, offset, bytes);
+        mark_dirty(&mem_root, offset, bytes);
+        return mem_root.base + offset;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check whether ptr lies inside the small-block region.
+ */
+static int in_small(const void* ptr) {
+    if (!mem_small_block) return 0;
+    size_t offset = (const char*)ptr - mem_root.base;
+    return offset >= mem_small_start && offset < mem_small_end;
+}
+
+/**
+ * @brief Number of granules of the small allocation starting at ptr.
+ *
+ * @return The run length, or 0 if ptr is not the start of a live allocation.
+ */
+static unsigned small_run(const void* ptr) {
+    size_t offset = (const char*)ptr - mem_root.base - mem_small_start;
+    if (offset & (((size_t)1 << mem_small_shift) - 1)) return 0;
+
+    size_t granule = offset >> mem_small_shift;
+    size_t word = granule / 64;
+    unsigned bit = granule % 64;
+    if (word >= mem_small_words || mem_small_free[word] & ((uint64_t)1 << bit)) return 0;
+    // The granule before a run start is free or ends another run (runs never straddle words)
+    if (bit && !((mem_small_free[word] | mem_small_ends[word]) & ((uint64_t)1 << (bit - 1)))) return 0;
+
+    uint64_t ends = mem_small_ends[word] >> bit;
+    return ends ? (unsigned)__builtin_ctzll(ends) + 1 : 0;
+}
+
+/**
+ * @brief Free a small allocation by setting its granules' free bits.
+ */
+static void small_free(void* ptr) {
+    unsigned count = small_run(ptr);
+    if (!count) return;  // Unknown or already free
+
+    size_t granule = ((char*)ptr - mem_root.base - mem_small_start) >> mem_small_shift;
+    unsigned bit = granule % 64;
+    uint64_t run = count == 64 ? UINT64_MAX : ((uint64_t)1 << count) - 1;
+    mem_small_free[granule / 64] |= run << bit;
+    mem_small_ends[granule / 64] &= ~((uint64_t)1 << (bit + count - 1));
+    mem_small_used -= count;
+}
+
+/**
+ * @brief Route small requests to a bitmap-managed region of the global pool.
+ *
+ * Requests of 1 to threshold bytes made through mem_alloc, mem_calloc and
+ * mem_resize are served from a region of region_size bytes, divided into
+ * granules tracked by a free bitmap; they fall back to the block list when
+ * the region is full. A small allocation needs no MemBlock and freeing it
+ * just sets bits. The region is carved from the pool on the first small
+ * request and returned by mem_deinit or by disabling it.
+ *
+ * @param config Region size, granule and threshold; NULL disables the region.
+ *        A granule of 0 selects 16 bytes.
+ * @return 0 on success, -1 if the granule is not a power of two, the
+ *         threshold exceeds 64 granules, or small blocks are still allocated.
+ */
+int mem_set_small_blocks(const MemSmallBlocks* config) {
+    MemSmallBlocks disabled = { 0, 16, 0 };
+    MemSmallBlocks settings = config ? *config : disabled;
+    if (!settings.granule) settings.granule = 16;
+    if (settings.granule & (settings.granule - 1)) return -1;
+    if (settings.threshold > 64 * settings.granule) return -1;
+
+    lock_pool();
+    int result = -1;
+    if (mem_small_used == 0) {
+        small_release(1);
+        mem_small_config = settings;
+        result = 0;
+    }
+    unlock_pool();
+    return result;
+}
+
+/**
+ * @brief Push page index + 1 onto the front of a page bag list.
+ */
+static void bag_push(uint32_t* head, uint32_t page) {
+    MemBagPage* desc = &mem_bag_pages[page - 1];
+    desc->prev = 0;
+    desc->next = *head;
+    if (*head) mem_bag_pages[*head - 1].prev = page;
+    *head = page;
+}
+
+/**
+ * @brief Remove page index + 1 from a page bag list.
+ */
+static void bag_unlink(uint32_t* head, uint32_t page) {
+    MemBagPage* desc = &mem_bag_pages[page - 1];
+    if (desc->prev) mem_bag_pages[desc->prev - 1].next = desc->next;
+    else *head = desc->next;
+    if (desc->next) mem_bag_pages[desc->next - 1].prev = desc->prev;
+    desc->prev = desc->next = 0;
+}
+
+/**
+ * @brief Carve the page bags from the global pool on the first request for them.
+ *
+ * The extent is one block marked MEM_BLOCK_BAGS, padded so the bags start on
+ * a MEM_BAG_PAGE boundary. Every page starts on the empty list.
+ *
+ * @return 0 if the page bags are ready, -1 if they could not be set up.
+ */
+static int bag_reserve(void) {
+    if (mem_bag_block) return 0;
+    if (mem_bag_unavailable) return -1;
+
+    size_t count = mem_bag_config.pages;
+    MemBagPage* pages = count <= UINT32_MAX ? calloc(count, sizeof(MemBagPage)) : NULL;
+    size_t size = count <= SIZE_MAX / MEM_BAG_PAGE - 1 ? round_request(count * MEM_BAG_PAGE + MEM_BAG_PAGE - 1) : 0;
+    MemBlock* block = pages && size ? block_take(&mem_root, size) : NULL;
+    if (!block) {
+        free(pages);
+        mem_bag_unavailable = 1;
+        return -1;
+    }
+    block->is_block_free = MEM_BLOCK_BAGS;
+
+    mem_bag_block = block;
+    mem_bag_start = (block->offset + MEM_BAG_PAGE - 1) & ~(size_t)(MEM_BAG_PAGE - 1);
+    mem_bag_end = mem_bag_start + count * MEM_BAG_PAGE;
+    mem_bag_pages = pages;
+    mem_bag_count = count;
+    memset(mem_bag_partial, 0, sizeof(mem_bag_partial));
+    mem_bag_empty = 0;
+    for (size_t k = count; k > 0; k--) bag_push(&mem_bag_empty, (uint32_t)k);
+    mem_bag_live = 0;
+    return 0;
+}
+
+/**
+ * @brief Give the page bags' extent back to the pool and drop their descriptors.
+ *
+ * @param return_extent Non-zero to free the extent; 0 when the pool is going away.
+ */
+static void bag_release(int return_extent) {
+    MemBlock* block = mem_bag_block;
+    mem_bag_block = NULL;  // Detach first so free_locked treats the extent as a plain block
+    if (block && return_extent) {
+        block->is_block_free = 0;
+        free_locked(&mem_root, mem_root.base + block->offset);
+    }
+    free(mem_bag_pages);
+    mem_bag_pages = NULL;
+    mem_bag_count = 0;
+    mem_bag_live = 0;
+    mem_bag_unavailable = 0;
+}
+
+/**
+ * @brief Allocate an object of size bytes (at most MEM_BAG_MAX) from a page bag.
+ *
+ * Takes the first partial page of the size, or an empty page that is then
+ * given the size. A page that fills up leaves its partial list.
+ *
+ * @return Pointer to the object, or NULL if every page is taken.
+ */
+static void* bag_alloc(size_t size, int zeroed) {
+    if (bag_reserve() != 0) return NULL;
+
+    size_t bin = (size + MEM_BAG_GRANULE - 1) / MEM_BAG_GRANULE;
+    size_t object = bin * MEM_BAG_GRANULE;
+    unsigned slots = MEM_BAG_PAGE / object;
+    uint32_t page = mem_bag_partial[bin];
+    if (!page) {
+        page = mem_bag_empty;
+        if (!page) return NULL;
+        bag_unlink(&mem_bag_empty, page);
+        MemBagPage* desc = &mem_bag_pages[page - 1];
+        desc->size = (uint16_t)object;
+        desc->live = 0;
+        memset(desc->free_bits, 0, sizeof(desc->free_bits));
+        for (unsigned w = 0; w * 64 < slots; w++)
+            desc->free_bits[w] = slots - w * 64 >= 64 ? UINT64_MAX : ((uint64_t)1 << (slots - w * 64)) - 1;
+        bag_push(&mem_bag_partial[bin], page);
+    }
+
+    MemBagPage* desc = &mem_bag_pages[page - 1];
+    unsigned w = 0;
+    while (!desc->free_bits[w]) w++;
+    unsigned bit = (unsigned)__builtin_ctzll(desc->free_bits[w]);
+    desc->free_bits[w] &= desc->free_bits[w] - 1;
+    if (++desc->live == slots) bag_unlink(&mem_bag_partial[bin], page);
+    mem_bag_live++;
+
+    size_t offset = mem_bag_start + (size_t)(page - 1) * MEM_BAG_PAGE + (w * 64 + bit) * object;
+    if (zeroed) zero_range(&mem_root, offset, object);
+    mark_dirty(&mem_root, offset, object);
+    return mem_root.base + offset;
+}
+
+/**
+ * @brief Check whether ptr lies inside the page bags.
+ */
+static int in_bags(const void* ptr) {
+    if (!mem_bag_block) return 0;
+    size_t offset = (const char*)ptr - mem_root.base;
+    return offset >= mem_bag_start && offset < mem_bag_end;
+}
+
+/**
+ * @brief Find the descriptor and slot of the live page bag object at ptr.
+ *
+ * @return The page's descriptor, or NULL if ptr is not the start of a live object.
+ */
+static MemBagPage* bag_lookup(const void* ptr, unsigned* slot) {
+    size_t offset = (const char*)ptr - mem_root.base - mem_bag_start;
+    MemBagPage* desc = &mem_bag_pages[offset / MEM_BAG_PAGE];
+    size_t within = offset % MEM_BAG_PAGE;
+    if (!desc->size || within % desc->size || within / desc->size >= MEM_BAG_PAGE / desc->size) return NULL;
+
+    *slot = (unsigned)(within / desc->size);
+    if (desc->free_bits[*slot / 64] & ((uint64_t)1 << (*slot % 64))) return NULL;
+    return desc;
+}
+
+/**
+ * @brief Free a page bag object; a page left without live objects becomes empty again.
+ */
+static void bag_free(void* ptr) {
+    unsigned slot;
+    MemBagPage* desc = bag_lookup(ptr, &slot);
+    if (!desc) return;  // Unknown or already free
+
+    uint32_t page = (uint32_t)(desc - mem_bag_pages) + 1;
+    size_t bin = desc->size / MEM_BAG_GRANULE;
+    if (desc->live == MEM_BAG_PAGE / desc->size) bag_push(&mem_bag_partial[bin], page);
+    desc->free_bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+    mem_bag_live--;
+    if (--desc->live == 0) {
+        bag_unlink(&mem_bag_partial[bin], page);
+        desc->size = 0;
+        bag_push(&mem_bag_empty, page);
+    }
+}
+
+/**
+ * @brief Route tiny requests to size-segregated pages of the global pool.
+ *
+ * Requests of 1 to max_size bytes made through mem_alloc, mem_calloc and
+ * mem_resize are rounded up to a multiple of MEM_BAG_GRANULE and served from
+ * pages of MEM_BAG_PAGE bytes that each hold objects of one size ("big bag
+ * of pages"). The size of an object follows from its address through its
+ * page's descriptor, so objects have no header and need no MemBlock. Page
+ * bags take precedence over the small-block region; requests fall back to
+ * it, and then to the block list, when no page is free. The pages are
+ * carved from the pool on the first request and returned by mem_deinit or
+ * by disabling them.
+ *
+ * @param config Number of pages and the largest object size; NULL disables them.
+ * @return 0 on success, -1 if max_size exceeds MEM_BAG_MAX or objects are still allocated.
+ */
+int mem_set_page_bags(const MemPageBags* config) {
+    MemPageBags disabled = { 0, 0 };
+    MemPageBags settings = config ? *config : disabled;
+    if (settings.max_size > MEM_BAG_MAX) return -1;
+
+    lock_pool();
+    int result = -1;
+    if (mem_bag_live == 0) {
+        bag_release(1);
+        mem_bag_config = settings;
+        result = 0;
+    }
+    unlock_pool();
+    return result;
+}
+
+/**
+ * @brief Allocate from the open region, the page bags, the small-block region or
+ *        the block list; the caller holds the pool lock.
+ *
+ * Regions and page bags belong to the global pool; child pools always use their block list.
+ */
+static void* alloc_locked(MemPool* pool, size_t size, int zeroed) {
+    if (!pool->base) return NULL;
+
+    mem_alloc_events++;
+    if (pool == &mem_root) {
+        if (mem_region_depth) {
+            void* ptr = region_alloc(size, zeroed);
+            if (ptr) return ptr;  // A full region falls back to the block list
+        }
+        if (size && size <= mem_bag_config.max_size && mem_bag_config.pages) {
+            void* ptr = bag_alloc(size, zeroed);
+            if (ptr) return ptr;
+        }
+        if (size && size <= mem_small_config.threshold && mem_small_config.region_size) {
+            void* ptr = small_alloc(size, zeroed);
+            if (ptr) return ptr;
+        }
+    }
+    void* ptr = block_alloc(pool, size, zeroed);
+    if (!ptr && pool->steal_min) ptr = loan_alloc(pool, size, zeroed);
+    return ptr;
+}
+
+/**
+ * @brief Allocate a memory block of a given size from the memory pool.
+ *
+ * While a region is open (see mem_region_begin) the allocation is a bump of
+ * the region pointer; otherwise, or once the region's extent is full, it
+ * comes from the block list and must be freed with mem_free.
+ *
+ * @param size Size of the memory block to allocate in bytes.
+ * @return Pointer to the allocated memory block, or NULL if allocation fails.
+ */
+void* mem_alloc(size_t size) {
+    lock_pool();
+    void* ptr = alloc_locked(&mem_root, size, 0);
+    unlock_pool();
+    return ptr;
+}
+
+/**
+ * @brief Allocate a zero-initialized array of n elements of size bytes each.
+ *
+ * Pages that are known to be zero (never handed out since they were mapped,
+ * or decommitted by mem_trim) are not touched; only the rest is cleared.
+ *
+ * @param n Number of elements.
+ * @param size Size of each element in bytes.
+ * Unlike mem_alloc(0), which points at the first free block without taking
+ * it, a zero-byte request allocates nothing and returns NULL.
+ *
+ * @return Pointer to the zeroed block, or NULL on overflow, a zero-byte request or allocation failure.
+ */
+void* mem_calloc(size_t n, size_t size) {
+    if (n == 0 || size == 0 || n > SIZE_MAX / size) return NULL;
+
+    lock_pool();
+    void* ptr = alloc_locked(&mem_root, n * size, 1);
+    unlock_pool();
+    return ptr;
+}
+
+/**
+ * @brief Check whether ptr lies inside the extent of the open region.
+ */
+static int in_region(const void* ptr) {
+    if (!mem_region_depth) return 0;
+    size_t offset = (const char*)ptr - mem_root.base;
+    return offset >= mem_region_block->offset &&
+           offset < mem_region_block->offset + mem_region_block->size;
+}
+
+/**
+ * @brief Size of the region allocation starting at offset, found by binary search.
+ *
+ * @param newest Set to non-zero if it is the newest allocation (may be NULL).
+ * @return Its size up to the next allocation or the bump pointer, or 0 if no allocation starts there.
+ */
+static size_t region_size(size_t offset, int* newest) {
+    size_t low = 0, high = mem_region_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (mem_region_starts[mid] < offset) low = mid + 1;
+        else high = mid;
+    }
+    if (low == mem_region_count || mem_region_starts[low] != offset) return 0;
+    if (newest) *newest = low + 1 == mem_region_count;
+    return (low + 1 < mem_region_count ? mem_region_starts[low + 1] : mem_region_top) - offset;
+}
+
+/**
+ * @brief Open a region; until it is released mem_alloc bump-allocates.
+ *
+ * The outermost region claims the largest free block as its extent. Nested
+ * regions share that extent and only remember where the bump pointer was.
+ *
+ * @return A mark for mem_region_release, or MEM_REGION_INVALID if no free
+ *         block is available or MEM_REGION_MAX_DEPTH regions are already open.
+ */
+static mem_region_t region_begin_locked(void) {
+    if (!mem_root.base || mem_region_depth == MEM_REGION_MAX_DEPTH) return MEM_REGION_INVALID;
+
+    if (mem_region_depth == 0) {
+        coalesce_deferred(&mem_root);
+        if (index_reserve(&mem_root) != 0) return MEM_REGION_INVALID;
+        MemBlock* largest = NULL;
+        for (MemBlock* current_block = mem_root.block_list; current_block; current_block = current_block->next) {
+            if (current_block->is_block_free == 1 && (!largest || current_block->size > largest->size))
+                largest = current_block;
+        }
+        if (!largest) return MEM_REGION_INVALID;
+
+        largest->is_block_free = 0;
+        table_sync(&mem_root, largest);
+        index_insert(&mem_root, largest);
+        mem_region_block = largest;
+        mem_region_top = largest->offset;
+    }
+
+    mem_region_marks[mem_region_depth++] = mem_region_top;
+    return mem_region_depth;
+}
+
+mem_region_t mem_region_begin(void) {
+    lock_pool();
+    mem_region_t mark = region_begin_locked();
+    unlock_pool();
+    return mark;
+}
+
+/**
+ * @brief Free everything allocated since mark and close the regions opened after it.
+ *
+ * Rewinding the bump pointer is O(1), plus dropping the recorded starts of
+ * the freed allocations. Releasing the outermost region returns its extent to
+ * the block list with a single free.
+ *
+ * @param mark Value returned by mem_region_begin.
+ */
+void mem_region_release(mem_region_t mark) {
+    lock_pool();
+    if (mark != MEM_REGION_INVALID && mark <= mem_region_depth) {
+        mem_region_top = mem_region_marks[mark - 1];
+        while (mem_region_count && mem_region_starts[mem_region_count - 1] >= mem_region_top) mem_region_count--;
+        mem_region_depth = mark - 1;
+
+        if (mem_region_depth == 0) {
+            MemBlock* extent = mem_region_block;
+            mem_region_block = NULL;
+            free_locked(&mem_root, mem_root.base + extent->offset);
+        }
+    }
+    unlock_pool();
+}
+
+/**
+ * @brief Free a previously allocated memory block.
+ *
+ * Marks the block as free and merges with adjacent free blocks if possible.
+ * In deferred mode the block is parked on a quick list instead (see
+ * mem_set_coalescing). Region allocations are ignored; they are freed by
+ * mem_region_release. So are child pool extents, freed by mem_pool_destroy,
+ * and the blocks of handles, freed by mem_handle_free.
+ *
+ * @param pool Pool the block was allocated from.
+ * @param ptr Pointer to the memory block to free.
+ */
+static void free_locked(MemPool* pool, void* ptr) {
+    if (!ptr || !pool->base) return;
+    if (pool == &mem_root && in_region(ptr)) return;  // Released together with its region
+    if (pool == &mem_root && in_small(ptr)) {
+        small_free(ptr);
+        return;
+    }
+    if (pool == &mem_root && in_bags(ptr)) {
+        bag_free(ptr);
+        return;
+    }
+    if (pool->loans && ((char*)ptr < pool->base || (char*)ptr >= pool->base + pool->size)) {
+        MemPool* loan = loan_of(pool, ptr);
+        if (loan) loan_free(loan, ptr);
+        return;
+    }
+
+    size_t offset = (char*)ptr - pool->base;
+    MemBlock* current_block = index_find(pool, offset);
+    if (!current_block || current_block->is_block_free) return;  // Unknown, already free or a child pool
+    if (current_block->handle) return;  // Its handle entry would dangle
+
+    if (mem_coalesce_mode == MEM_COALESCE_DEFERRED && current_block->size < MEM_QUICK_BINS) {
+        quick_push(pool, current_block);
+        return;
+    }
+
+    index_remove(pool, current_block);
+    current_block->is_block_free = 1;
+    table_sync(pool, current_block);
+
+    // Merge with next block if it is free
+    if (current_block->next && current_block->next->is_block_free == 1)
+        merge_next(pool, current_block);
+
+    // Merge with previous block if it is free
+    if (current_block->prev && current_block->prev->is_block_free == 1)
+        merge_next(pool, current_block->prev);
+}
+
+void mem_free(void* ptr) {
+    lock_pool();
+    free_locked(&mem_root, ptr);
+    unlock_pool();
+}
+
+/**
+ * @brief Number of bytes that can be used at ptr without calling mem_resize.
+ *
+ * For a block-list allocation this is the size of its block, which may exceed
+ * the requested size. For a region allocation it is the space up to the next
+ * allocation, or up to the region bump pointer for the newest one.
+ *
+ * @return Usable bytes, or 0 if ptr is not a live allocation.
+ */
+static size_t usable_size_locked(void* ptr) {
+    if (!ptr || !mem_root.base) return 0;
+
+    size_t offset = (char*)ptr - mem_root.base;
+    if (in_region(ptr)) return region_size(offset, NULL);
+    if (in_small(ptr)) return (size_t)small_run(ptr) << mem_small_shift;
+    if (in_bags(ptr)) {
+        unsigned slot;
+        MemBagPage* desc = bag_lookup(ptr, &slot);
+        return desc ? desc->size : 0;
+    }
+
+    MemBlock* block = index_find(&mem_root, offset);
+    return block && block->is_block_free == 0 ? block->size : 0;
+}
+
+size_t mem_usable_size(void* ptr) {
+    lock_pool();
+    size_t usable = usable_size_locked(ptr);
+    unlock_pool();
+    return usable;
+}
+
+/**
+ * @brief Tell the kernel how the pages of one allocation will be used.
+ *
+ * The advice covers every page the block touches, so a page it shares with a
+ * neighbour gets it too; all of it is a hint and never changes the data. COLD
+ * (MADV_COLD) only deactivates the pages: nothing is written or dropped by the
+ * call, but under memory pressure they are reclaimed before active ones, and
+ * for a file-backed pool that writes them to the file instead of to swap.
+ *
+ * @param ptr A live allocation whose size is known (see mem_usable_size).
+ * @return 0 on success, -1 for an unknown pointer or advice, or if the kernel refuses.
+ */
+int mem_advise(void* ptr, MemAdvice advice) {
+    int hint;
+    switch (advice) {
+    case MEM_ADVICE_NORMAL: hint = MADV_NORMAL; break;
+    case MEM_ADVICE_SEQUENTIAL: hint = MADV_SEQUENTIAL; break;
+    case MEM_ADVICE_WILLNEED: hint = MADV_WILLNEED; break;
+#ifdef MADV_COLD
+    case MEM_ADVICE_COLD: hint = MADV_COLD; break;
+#endif
+    default: return -1;
+    }
+
+    lock_pool();
+    size_t usable = usable_size_locked(ptr);
+    unlock_pool();
+    if (!usable) return -1;
+
+    uintptr_t first = (uintptr_t)ptr & ~(uintptr_t)(mem_page_size - 1);
+    uintptr_t last = ((uintptr_t)ptr + usable + mem_page_size - 1) & ~(uintptr_t)(mem_page_size - 1);
+    return madvise((void*)first, last - first, hint) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Free a block whose size the caller already knows.
+ *
+ * Release builds ignore size and do exactly what mem_free does: the block's
+ * node still has to be found to free it, and the offset index finds it
+ * without needing the size. Debug builds check the caller's size against
+ * the block's usable size and report a mismatch instead of freeing.
+ *
+ * @param ptr Pointer returned by mem_alloc, mem_calloc or mem_resize.
+ * @param size Size the block was requested with (only checked in DEBUG builds).
+ */
+void mem_free_sized(void* ptr, size_t size) {
+    lock_pool();
+#ifdef DEBUG
+    size_t usable = usable_size_locked(ptr);
+    if (ptr && !in_region(ptr) && (size > usable || usable == 0)) {
+        fprintf(stderr, "mem_free_sized: %p is %zu bytes, caller passed %zu\n", ptr, usable, size);
+        unlock_pool();
+        return;
+    }
+#else
+    (void)size;
+#endif
+    free_locked(&mem_root, ptr);
+    unlock_pool();
+}
+
+// Resize an allocated memory block to a new size; the caller holds the pool lock
+static void* resize_locked(MemPool* pool, void* ptr, size_t size) {
+    if (!ptr) return alloc_locked(pool, size, 0);
+    if (size == 0) {
+        free_locked(pool, ptr);
+        return NULL;
+    }
+
+    if (pool == &mem_root && in_small(ptr)) {
+        size_t usable = (size_t)small_run(ptr) << mem_small_shift;
+        if (!usable) return NULL;
+        if (size <= usable) return ptr;
+        char* new_ptr = alloc_locked(pool, size, 0);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, usable);
+            small_free(ptr);
+        }
+        return new_ptr;
+    }
+
+    if (pool == &mem_root && in_bags(ptr)) {
+        unsigned slot;
+        MemBagPage* desc = bag_lookup(ptr, &slot);
+        if (!desc) return NULL;
+        if (size <= desc->size) return ptr;
+        char* new_ptr = alloc_locked(pool, size, 0);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, desc->size);
+            bag_free(ptr);
+        }
+        return new_ptr;
+    }
+
+    if (pool == &mem_root && in_region(ptr)) {
+        // The newest region allocation can grow or shrink in place
+        size_t offset = (char*)ptr - pool->base;
+        size_t end = mem_region_block->offset + mem_region_block->size;
+        size_t aligned = align_request(size);
+        int newest = 0;
+        size_t old_size = region_size(offset, &newest);
+        if (!old_size) return NULL;
+        if (newest && aligned && aligned <= end - offset) {
+            mem_region_top = offset + aligned;
+            mark_dirty(pool, offset, aligned);
+            return ptr;
+        }
+        char* new_ptr = alloc_locked(pool, size, 0);
+        if (new_ptr) memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        return new_ptr;
+    }
+
+    if (pool->loans && ((char*)ptr < pool->base || (char*)ptr >= pool->base + pool->size)) {
+        // Resize inside the loan if it has room, else move anywhere the pool may allocate
+        MemPool* loan = loan_of(pool, ptr);
+        MemBlock* block = loan ? index_find(loan, (char*)ptr - loan->base) : NULL;
+        if (!block || block->is_block_free) return NULL;
+        size_t old_size = block->size;
+        char* new_ptr = resize_locked(loan, ptr, size);
+        if (new_ptr) return new_ptr;
+        new_ptr = alloc_locked(pool, size, 0);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, old_size);
+            loan_free(loan, ptr);
+        }
+        return new_ptr;
+    }
+
+    size_t offset = (char*)ptr - pool->base;
+    MemBlock* current_block = index_find(pool, offset);
+    if (!current_block || current_block->is_block_free || current_block->handle) return NULL;
+
+    size_t old_size = current_block->size;
+    size = round_request(size);
+    if (size == 0) return NULL;
+
+    if (current_block->size >= size) {
+        // Split the block
+        if (trim_block(pool, current_block, size) != 0) return NULL;
+        return ptr;
+    }
+
+    // Try to merge with next if possible
+    if (current_block->next && current_block->next->is_block_free == 1 &&
+        current_block->size + current_block->next->size >= size) {
+        merge_next(pool, current_block);
+
+        // Split again if oversized
+        if (trim_block(pool, current_block, size) != 0) return NULL;
+
+        mark_dirty(pool, offset, current_block->size);
+        return ptr;
+    }
+
+    // Fallback: allocate new, copy data
+    void* new_ptr = alloc_locked(pool, size, 0);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, old_size);
+        free_locked(pool, ptr);
+    }
+    return new_ptr;
+}
+
+// Resize an allocated memory block to a new size
+void* mem_resize(void* ptr, size_t size) {
+    lock_pool();
+    void* new_ptr = resize_locked(&mem_root, ptr, size);
+    unlock_pool();
+    return new_ptr;
+}
+
+/**
+ * @brief Resolve a handle to its table entry.
+ *
+ * @return The entry, or NULL if the handle is out of range or not in use.
+ */
+static MemHandleEntry* handle_entry(mem_handle_t handle) {
+    if (handle == MEM_HANDLE_INVALID || handle > mem_handle_capacity) return NULL;
+    MemHandleEntry* entry = &mem_handles[handle - 1];
+    return entry->block ? entry : NULL;
+}
+
+/**
+ * @brief Allocate a relocatable block and return a handle to it.
+ *
+ * The block is allocated like mem_alloc, but its address is only valid while
+ * the handle is locked. Unlocked handle blocks may be moved by mem_compact.
+ *
+ * @param size Size of the block in bytes (non-zero).
+ * @return A handle, or MEM_HANDLE_INVALID if the allocation fails.
+ */
+static mem_handle_t handle_alloc_locked(size_t size) {
+    if (!mem_root.base || size == 0) return MEM_HANDLE_INVALID;
+
+    if (!mem_handle_free_list) {
+        uint32_t capacity = mem_handle_capacity ? mem_handle_capacity * 2 : 64;
+        MemHandleEntry* table = realloc(mem_handles, capacity * sizeof(MemHandleEntry));
+        if (!table) return MEM_HANDLE_INVALID;
+
+        // Chain the new slots so the lowest index is handed out first
+        for (uint32_t i = mem_handle_capacity; i < capacity; i++) {
+            table[i].block = NULL;
+            table[i].pins = 0;
+            table[i].next_free = i + 1 < capacity ? i + 2 : 0;
+        }
+        mem_handle_free_list = mem_handle_capacity + 1;
+        mem_handles = table;
+        mem_handle_capacity = capacity;
+    }
+
+    void* ptr = block_alloc(&mem_root, size, 0);  // Handle blocks never come from a region
+    if (!ptr) return MEM_HANDLE_INVALID;
+
+    MemBlock* block = index_find(&mem_root, (char*)ptr - mem_root.base);
+
+    mem_handle_t handle = mem_handle_free_list;
+    MemHandleEntry* entry = &mem_handles[handle - 1];
+    mem_handle_free_list = entry->next_free;
+    entry->block = block;
+    entry->pins = 0;
+    entry->next_free = 0;
+    block->handle = handle;
+    return handle;
+}
+
+mem_handle_t mem_handle_alloc(size_t size) {
+    lock_pool();
+    mem_handle_t handle = handle_alloc_locked(size);
+    unlock_pool();
+    return handle;
+}
+
+/**
+ * @brief Pin a handle's block and return its current address.
+ *
+ * Locks nest; the block stays in place until every lock is released.
+ *
+ * @return The block address, or NULL for an invalid handle.
+ */
+void* mem_handle_lock(mem_handle_t handle) {
+    void* ptr = NULL;
+    lock_pool();
+    MemHandleEntry* entry = handle_entry(handle);
+    if (entry) {
+        entry->pins++;
+        ptr = mem_root.base + entry->block->offset;
+    }
+    unlock_pool();
+    return ptr;
+}
+
+/**
+ * @brief Release one lock taken by mem_handle_lock.
+ */
+void mem_handle_unlock(mem_handle_t handle) {
+    lock_pool();
+    MemHandleEntry* entry = handle_entry(handle);
+    if (entry && entry->pins > 0) entry->pins--;
+    unlock_pool();
+}
+
+/**
+ * @brief Free a handle and the block behind it.
+ */
+void mem_handle_free(mem_handle_t handle) {
+    lock_pool();
+    MemHandleEntry* entry = handle_entry(handle);
+    if (entry) {
+        MemBlock* block = entry->block;
+        block->handle = 0;
+        entry->block = NULL;
+        entry->pins = 0;
+        entry->next_free = mem_handle_free_list;
+        mem_handle_free_list = handle;
+
+        free_locked(&mem_root, mem_root.base + block->offset);
+    }
+    unlock_pool();
+}
+
+/**
+ * @brief Slide unpinned handle blocks down to remove external fragmentation.
+ *
+ * Deferred blocks are merged first. Then, walking the list once, each free
+ * block that precedes an unpinned handle block swaps places with it: the data
+ * is moved down and the free space bubbles up, merging with any free block it
+ * meets. Pinned handle blocks and plain mem_alloc blocks never move, so free
+ * space can only gather between them.
+ *
+ * @return Number of bytes moved.
+ */
+static size_t compact_locked(void) {
+    if (!mem_root.base) return 0;
+    coalesce_deferred(&mem_root);
+
+    size_t moved = 0;
+    MemBlock* previous_block = NULL;
+    MemBlock* current_block = mem_root.block_list;
+
+    while (current_block) {
+        MemBlock* next_block = current_block->next;
+
+        if (current_block->is_block_free == 1 && next_block && next_block->is_block_free == 0 &&
+            next_block->handle && mem_handles[next_block->handle - 1].pins == 0) {
+            memmove(mem_root.base + current_block->offset, mem_root.base + next_block->offset, next_block->size);
+            mark_dirty(&mem_root, current_block->offset, next_block->size);
+            moved += next_block->size;
+
+            // Swap list order: previous -> next_block -> current_block
+            index_remove(&mem_root, next_block);
+            next_block->offset = current_block->offset;
+            current_block->offset = next_block->offset + next_block->size;
+            index_insert(&mem_root, next_block);
+            table_sync(&mem_root, next_block);
+            table_sync(&mem_root, current_block);
+            current_block->next = next_block->next;
+            if (current_block->next) current_block->next->prev = current_block;
+            next_block->next = current_block;
+            current_block->prev = next_block;
+            next_block->prev = previous_block;
+            if (previous_block) previous_block->next = next_block;
+            else mem_root.block_list = next_block;
+
+            // The free space may now touch another free block
+            if (current_block->next && current_block->next->is_block_free == 1)
+                merge_next(&mem_root, current_block);
+
+            previous_block = next_block;
+            continue;
+        }
+
+        previous_block = current_block;
+        current_block = next_block;
+    }
+
+    mem_root.next_fit_offset = 0;
+    return moved;
+}
+
+size_t mem_compact(void) {
+    lock_pool();
+    size_t moved = compact_locked();
+    unlock_pool();
+    return moved;
+}
+
+/**
+ * @brief Return the pages inside free blocks to the operating system.
+ *
+ * Whole pages within free blocks are decommitted with madvise(MADV_DONTNEED).
+ * The kernel hands them back zero-filled on the next touch, so they are
+ * recorded as known-zero and mem_calloc will not clear them again. A
+ * file-backed pool would read the old data back after MADV_DONTNEED, so its
+ * pages are punched out of the file instead, which frees their disk blocks too.
+ *
+ * @return Number of bytes decommitted.
+ */
+static size_t trim_locked(void) {
+    if (!mem_root.base) return 0;
+
+    size_t released = 0;
+    for (MemBlock* current_block = mem_root.block_list; current_block; current_block = current_block->next) {
+        if (current_block->is_block_free != 1) continue;
+
+        size_t first = (current_block->offset + mem_page_size - 1) / mem_page_size;
+        size_t last = (current_block->offset + current_block->size) / mem_page_size;
+        if (first >= last) continue;  // No whole page inside this block
+
+        size_t length = (last - first) * mem_page_size;
+        int failed = mem_pool_fd >= 0
+                         ? fallocate(mem_pool_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                     (off_t)(first * mem_page_size), (off_t)length)
+                         : madvise(mem_root.base + first * mem_page_size, length, MADV_DONTNEED);
+        if (failed) continue;
+        for (size_t page = first; page < last; page++)
+            mem_dirty_pages[page / 64] &= ~((uint64_t)1 << (page % 64));
+        released += (last - first) * mem_page_size;
+    }
+    return released;
+}
+
+size_t mem_trim(void) {
+    lock_pool();
+    size_t released = trim_locked();
+    unlock_pool();
+    return released;
+}
+
+/**
+ * @brief Report the current layout of the memory pool.
+ *
+ * Walks the block list once. metadata_bytes counts the MemBlock nodes, which
+ * live outside the pool. Deferred blocks count as free blocks of their own size;
+ * the extents of child pools count as used.
+ *
+ * @param pool The global pool or a child pool.
+ * @param stats Output structure; zeroed when the pool is not initialized.
+ */
+static void stats_locked(MemPool* pool, MemStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!pool->base) return;
+
+    stats->pool_size = pool->size;
+    for (MemBlock* current_block = pool->block_list; current_block; current_block = current_block->next) {
+        stats->block_count++;
+        if (current_block->is_block_free == 1 || current_block->is_block_free == MEM_BLOCK_DEFERRED) {
+            stats->free_block_count++;
+            stats->free_bytes += current_block->size;
+            if (current_block->size > stats->largest_free_block)
+                stats->largest_free_block = current_block->size;
+        } else {
+            stats->used_bytes += current_block->size;
+        }
+    }
+    stats->metadata_bytes = stats->block_count * sizeof(MemBlock) + pool->index_capacity * sizeof(MemBlock*) +
+                            pool->table_capacity * (2 * sizeof(uint32_t) + sizeof(MemBlock*));
+    if (pool == &mem_root) {
+        size_t pages = (pool->size + mem_page_size - 1) / mem_page_size;
+        stats->metadata_bytes += mem_handle_capacity * sizeof(MemHandleEntry) +
+                                 2 * mem_small_words * sizeof(uint64_t) + mem_bag_count * sizeof(MemBagPage) +
+                                 ((pages + 63) / 64 + 1) * sizeof(uint64_t);
+    } else {
+        stats->metadata_bytes += sizeof(MemPool);
+    }
+
+    // Pages are numbered from the global pool; a child's first and last page may be partial
+    size_t start = pool->root_offset, end = pool->root_offset + pool->size;
+    for (size_t page = start / mem_page_size; page * mem_page_size < end; page++) {
+        if (!(mem_dirty_pages[page / 64] & ((uint64_t)1 << (page % 64)))) {
+            size_t page_start = page * mem_page_size, page_end = page_start + mem_page_size;
+            stats->known_zero_bytes += (page_end < end ? page_end : end) - (page_start > start ? page_start : start);
+        }
+    }
+}
+
+void mem_get_stats(MemStats* stats) {
+    if (!stats) return;
+    lock_pool();
+    stats_locked(&mem_root, stats);
+    unlock_pool();
+}
+
+/**
+ * @brief Resolve the pool argument of the mem_pool_* functions (NULL = the global pool).
+ */
+static MemPool* pool_or_root(MemPool* pool) {
+    return pool ? pool : &mem_root;
+}
+
+static void pool_destroy_locked(MemPool* pool);
+
+/**
+ * @brief Free the host-side state of a child pool and of all its descendants.
+ *
+ * Only metadata is touched: index tables, MemPool structures and, with
+ * release_nodes set, the MemBlock nodes. The pool memory itself stays with
+ * the parent. Loans the pool borrowed are returned to their lenders when
+ * release_nodes is set; a loan the pool lent is dropped with it, which only
+ * happens when the borrower goes too (mem_pool_destroy refuses otherwise).
+ */
+static void pool_drop(MemPool* pool, int release_nodes) {
+    if (pool->borrower) {
+        MemPool** link = &pool->borrower->loans;
+        while (*link != pool) link = &(*link)->next_loan;
+        *link = pool->next_loan;
+    }
+    while (pool->loans) {
+        MemPool* loan = pool->loans;
+        pool->loans = loan->next_loan;
+        loan->borrower = NULL;
+        if (release_nodes) pool_destroy_locked(loan);  // Back to the sibling that lent it
+    }
+    while (pool->children) {
+        MemPool* child = pool->children;
+        pool->children = child->next_sibling;
+        pool_drop(child, release_nodes);
+    }
+    if (release_nodes) {
+        MemBlock* current_block = pool->block_list;
+        while (current_block) {
+            MemBlock* next_block = current_block->next;
+            node_free(current_block);
+            current_block = next_block;
+        }
+    }
+    free(pool->block_index);
+    free(pool->table_offset);
+    free(pool->table_fit);
+    free(pool->table_block);
+    free(pool);
+}
+
+/**
+ * @brief Carve a child pool of size bytes (already rounded) from parent; the caller holds the pool lock.
+ *
+ * @return The child pool, linked into the parent's children, or NULL.
+ */
+static MemPool* pool_carve(MemPool* parent, size_t size) {
+    MemPool* child = NULL;
+    if (parent->base && size) child = calloc(1, sizeof(MemPool));
+
+    MemBlock* extent = child ? block_take(parent, size) : NULL;
+    if (extent) {
+        child->base = parent->base + extent->offset;
+        child->size = extent->size;
+        child->root_offset = parent->root_offset + extent->offset;
+    }
+    if (!extent || pool_start(child) != 0) {
+        if (extent) free_locked(parent, parent->base + extent->offset);
+        if (child) pool_drop(child, 1);
+        return NULL;
+    }
+    extent->is_block_free = MEM_BLOCK_SUBPOOL;
+
+    child->parent = parent;
+    child->next_sibling = parent->children;
+    parent->children = child;
+    return child;
+}
+
+/**
+ * @brief Carve a child pool from one block of a parent pool.
+ *
+ * The child gets its own block list, index and quick lists over the block's
+ * extent, so its allocations never lengthen or fragment the parent's list.
+ * The placement, fragmentation and coalescing settings are shared with every
+ * pool; regions and handles stay with the global pool. The extent keeps its
+ * known-zero pages, so mem_pool_calloc in a fresh child skips them.
+ *
+ * @param parent Pool to carve from; NULL carves from the global pool.
+ * @param size Size of the child pool in bytes (rounded like a mem_alloc request).
+ * @return The child pool, or NULL if the parent has no large enough free block.
+ */
+MemPool* mem_pool_create(MemPool* parent, size_t size) {
+    lock_pool();
+    MemPool* child = pool_carve(pool_or_root(parent), round_request(size));
+    unlock_pool();
+    return child;
+}
+
+void* mem_pool_alloc(MemPool* pool, size_t size) {
+    lock_pool();
+    void* ptr = alloc_locked(pool_or_root(pool), size, 0);
+    unlock_pool();
+    return ptr;
+}
+
+void* mem_pool_calloc(MemPool* pool, size_t n, size_t size) {
+    if (n == 0 || size == 0 || n > SIZE_MAX / size) return NULL;  // Zero bytes: see mem_calloc
+
+    lock_pool();
+    void* ptr = alloc_locked(pool_or_root(pool), n * size, 1);
+    unlock_pool();
+    return ptr;
+}
+
+void mem_pool_free(MemPool* pool, void* ptr) {
+    lock_pool();
+    free_locked(pool_or_root(pool), ptr);
+    unlock_pool();
+}
+
+void* mem_pool_resize(MemPool* pool, void* ptr, size_t size) {
+    lock_pool();
+    void* new_ptr = resize_locked(pool_or_root(pool), ptr, size);
+    unlock_pool();
+    return new_ptr;
+}
+
+/**
+ * @brief Unlink a child pool from its parent, drop it and free its extent there;
+ *        the caller holds the pool lock.
+ */
+static void pool_destroy_locked(MemPool* pool) {
+    MemPool* parent = pool->parent;
+    MemPool** link = &parent->children;
+    while (*link != pool) link = &(*link)->next_sibling;
+    *link = pool->next_sibling;
+
+    char* extent = pool->base;
+    pool_drop(pool, 1);
+    index_find(parent, extent - parent->base)->is_block_free = 0;
+    free_locked(parent, extent);
+}
+
+/**
+ * @brief Find the loan of pool that contains ptr.
+ */
+static MemPool* loan_of(const MemPool* pool, const void* ptr) {
+    for (MemPool* loan = pool->loans; loan; loan = loan->next_loan) {
+        if ((const char*)ptr >= loan->base && (const char*)ptr < loan->base + loan->size) return loan;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Free a block inside a loan; a loan left without allocations goes back to its lender.
+ */
+static void loan_free(MemPool* loan, void* ptr) {
+    free_locked(loan, ptr);
+    MemBlock* first = loan->block_list;
+    if (first && !first->next && first->is_block_free == 1) pool_destroy_locked(loan);
+}
+
+/**
+ * @brief Serve a request the pool's own extent could not, from a loan or by stealing one.
+ *
+ * Existing loans are tried first. Otherwise the siblings are asked in turn
+ * for an extent of max(steal_min, size) bytes, then for just size bytes; the
+ * first one with room lends it as a child pool of its own, so it stays
+ * accounted for in the sibling and is returned with a single free.
+ *
+ * @return The allocation, or NULL if no sibling has a large enough free block.
+ */
+static void* loan_alloc(MemPool* pool, size_t size, int zeroed) {
+    for (MemPool* loan = pool->loans; loan; loan = loan->next_loan) {
+        void* ptr = block_alloc(loan, size, zeroed);
+        if (ptr) return ptr;
+    }
+    if (!pool->parent) return NULL;
+
+    size_t need = round_request(size);
+    size_t want = need > pool->steal_min ? need : round_request(pool->steal_min);
+    for (size_t amount = want; need && amount >= need; amount = amount > need ? need : 0) {
+        for (MemPool* sibling = pool->parent->children; sibling; sibling = sibling->next_sibling) {
+            if (sibling == pool) continue;
+            MemPool* loan = pool_carve(sibling, amount);
+            if (!loan) continue;
+            loan->borrower = pool;
+            loan->next_loan = pool->loans;
+            pool->loans = loan;
+            return block_alloc(loan, size, zeroed);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Let a child pool take free extents from its siblings when it runs out of room.
+ *
+ * When an allocation from pool fails, pool carves an extent of at least
+ * min_steal bytes from the first sibling (another child of the same parent)
+ * with a large enough free block and allocates from it. mem_pool_free and
+ * mem_pool_resize on pool find blocks in these loans by address, and a loan
+ * whose last block is freed goes straight back to its sibling. Loans are
+ * also returned when pool is destroyed; the sibling that lent one cannot be
+ * destroyed while it is out.
+ *
+ * @param pool A child pool; the global pool has no siblings.
+ * @param min_steal Smallest extent to take (0 = never steal).
+ * @return 0 on success, -1 if pool is NULL or the global pool.
+ */
+int mem_pool_set_stealing(MemPool* pool, size_t min_steal) {
+    if (!pool || pool == &mem_root) return -1;
+    lock_pool();
+    pool->steal_min = min_steal;
+    unlock_pool();
+    return 0;
+}
+
+/**
+ * @brief Check whether pool has lent an extent to a sibling (see mem_pool_set_stealing).
+ *
+ * A loan goes back as soon as its last block is freed, so one that is still
+ * out holds live blocks of the borrower.
+ */
+static int pool_has_loans_out(const MemPool* pool) {
+    for (const MemPool* child = pool->children; child; child = child->next_sibling) {
+        if (child->borrower) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Destroy a child pool together with everything allocated in it.
+ *
+ * Child pools of pool are destroyed with it. No block inside is freed one by
+ * one: the block nodes go back to the node free list and the whole extent is
+ * returned to the parent with a single free. A pool that has lent an extent
+ * to a sibling is left alone, since the sibling's blocks in it are still
+ * live; loans between pool's own descendants go away with them.
+ *
+ * @param pool Pool returned by mem_pool_create.
+ * @return 0 on success, -1 if pool is NULL, the global pool, or has loans out.
+ */
+int mem_pool_destroy(MemPool* pool) {
+    if (!pool || pool == &mem_root) return -1;
+
+    lock_pool();
+    int lent = pool_has_loans_out(pool);
+    if (!lent) pool_destroy_locked(pool);
+    unlock_pool();
+    return lent ? -1 : 0;
+}
+
+void mem_pool_get_stats(MemPool* pool, MemStats* stats) {
+    if (!stats) return;
+    lock_pool();
+    stats_locked(pool_or_root(pool), stats);
+    unlock_pool();
+}
+
+/**
+ * @struct MemFixedPool
+ * @brief Lock-free pool of fixed-size objects carved from one block of the global pool.
+ *
+ * Free objects form a Treiber stack linked through their first four bytes by
+ * index + 1. The head packs a 32-bit tag above the index of the top object in
+ * one 64-bit word, so push and pop are single-word compare-and-swaps and no
+ * 128-bit CAS is needed. The tag changes on every push and pop, so a thread
+ * that read the head before another thread popped and pushed the same object
+ * back (the ABA case) fails its CAS and retries.
+ *
+ * @var head Tag << 32 | index + 1 of the top free object (low half 0 = empty).
+ * @var block Block taken from the global pool, freed by mem_fixed_destroy.
+ * @var base First object, block rounded up to MEM_FIXED_ALIGN.
+ * @var object_size Stride between objects.
+ * @var count Number of objects.
+ */
+struct MemFixedPool {
+    uint64_t head;
+    char* block;
+    char* base;
+    size_t object_size;
+    uint32_t count;
+};
+
+/** Low half of MemFixedPool.head: index + 1 of the top object */
+#define MEM_FIXED_INDEX 0xFFFFFFFFull
+
+/** Alignment of every fixed-pool object, so the links' atomics are never split */
+#define MEM_FIXED_ALIGN _Alignof(max_align_t)
+
+/**
+ * @brief Carve a lock-free pool of count objects from the global pool.
+ *
+ * Objects are rounded up to a multiple of MEM_FIXED_ALIGN bytes, and the
+ * block is padded so the first one starts aligned however the global pool is
+ * laid out. Only creation and destruction take the pool lock; mem_fixed_alloc
+ * and mem_fixed_free never block.
+ *
+ * @return The pool, or NULL if the sizes overflow or the global pool is full.
+ */
+MemFixedPool* mem_fixed_create(size_t object_size, size_t count) {
+    if (object_size == 0 || count == 0 || count >= MEM_FIXED_INDEX || object_size > SIZE_MAX - MEM_FIXED_ALIGN)
+        return NULL;
+    object_size = (object_size + MEM_FIXED_ALIGN - 1) & ~(size_t)(MEM_FIXED_ALIGN - 1);
+    if (count > (SIZE_MAX - MEM_FIXED_ALIGN) / object_size) return NULL;
+
+    MemFixedPool* pool = calloc(1, sizeof(MemFixedPool));
+    if (!pool) return NULL;
+    lock_pool();
+    pool->block = block_alloc(&mem_root, object_size * count + MEM_FIXED_ALIGN - 1, 0);  // Never from a region
+    unlock_pool();
+    if (!pool->block) {
+        free(pool);
+        return NULL;
+    }
+    pool->base = (char*)(((uintptr_t)pool->block + MEM_FIXED_ALIGN - 1) & ~(uintptr_t)(MEM_FIXED_ALIGN - 1));
+
+    pool->object_size = object_size;
+    pool->count = (uint32_t)count;
+    for (uint32_t k = 0; k < pool->count; k++) {
+        uint32_t next = k + 1 < pool->count ? k + 2 : 0;
+        memcpy(pool->base + (size_t)k * object_size, &next, sizeof(next));
+    }
+    __atomic_store_n(&pool->head, 1, __ATOMIC_RELEASE);
+    return pool;
+}
+
+/**
+ * @brief Pop an object off the pool's free stack.
+ *
+ * The link read from the top object may be stale if another thread popped it
+ * meanwhile; the tagged CAS then fails and the pop retries with the new head.
+ * The object stays inside the pool's block, so the read is always in bounds.
+ *
+ * @return An object of the pool's object size, or NULL if all are in use.
+ */
+void* mem_fixed_alloc(MemFixedPool* pool) {
+    if (!pool) return NULL;
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t top = (uint32_t)(head & MEM_FIXED_INDEX);
+        if (!top) return NULL;
+        char* object = pool->base + (size_t)(top - 1) * pool->object_size;
+        uint64_t next = __atomic_load_n((uint32_t*)object, __ATOMIC_RELAXED);
+        uint64_t want = ((head >> 32) + 1) << 32 | next;
+        if (__atomic_compare_exchange_n(&pool->head, &head, want, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            return object;
+    }
+}
+
+/**
+ * @brief Push an object back onto the pool's free stack.
+ *
+ * Pointers outside the pool or not at an object boundary are ignored. Freeing
+ * an object twice is not detected.
+ */
+void mem_fixed_free(MemFixedPool* pool, void* object) {
+    if (!pool || !object) return;
+    size_t offset = (size_t)((char*)object - pool->base);
+    if (offset % pool->object_size || offset / pool->object_size >= pool->count) return;
+
+    uint64_t index = offset / pool->object_size + 1;
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    uint64_t want;
+    do {
+        __atomic_store_n((uint32_t*)object, (uint32_t)(head & MEM_FIXED_INDEX), __ATOMIC_RELAXED);
+        want = ((head >> 32) + 1) << 32 | index;
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, want, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Return the pool's block to the global pool; no thread may still use it.
+ */
+void mem_fixed_destroy(MemFixedPool* pool) {
+    if (!pool) return;
+    lock_pool();
+    free_locked(&mem_root, pool->block);
+    unlock_pool();
+    free(pool);
+}
+
+/**
+ * @brief Top up the quick lists of hot sizes to their targets with pre-split blocks.
+ *
+ * A size whose list ran dry since the last pass raises its target to the
+ * number of misses, at most config.refill; a size nobody allocated drops its
+ * target, so its parked blocks are merged by the next pass. Only lists below
+ * their target get new blocks, and the pass's coalescing leaves the target's
+ * worth of blocks parked, so a steady hot size is not merged and split again
+ * every pass.
+ */
+static void refill_quick_lists(void) {
+    for (size_t size = 1; size < MEM_QUICK_BINS; size++) {
+        uint32_t target = mem_quick_used[size] ? mem_quick_target[size] : 0;
+        if (mem_quick_misses[size] > target) target = mem_quick_misses[size];
+        if (target > mem_maint_config.refill) target = mem_maint_config.refill;
+        mem_quick_target[size] = target;
+        mem_quick_used[size] = 0;
+        mem_quick_misses[size] = 0;
+
+        uint32_t parked = 0;
+        for (MemBlock* quick = mem_root.quick_bins[size]; quick && parked < target; quick = quick->next_quick)
+            parked++;
+        for (uint32_t k = parked; k < target; k++) {
+            if (index_reserve(&mem_root) != 0) return;
+            MemBlock* block = find_free_block(&mem_root, size);
+            if (!block || trim_block(&mem_root, block, size) != 0 || block->size >= MEM_QUICK_BINS) return;
+            index_insert(&mem_root, block);
+            quick_park(&mem_root, block);
+            mem_maint_stats.refilled_blocks++;
+        }
+    }
+}
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief One maintenance pass; runs entirely with mem_lock held.
+ *
+ * Deferred frees are merged, except the blocks kept parked for hot sizes,
+ * hot quick lists are topped up, and once no allocation has happened for
+ * trim_idle_ms the free pages go back to the OS. How long the lock is held
+ * is bounded only by the duty cycle, not broken up within a pass.
+ */
+static void maintenance_pass(uint64_t now, uint64_t* idle_since, uint64_t* last_events) {
+    mem_maint_stats.passes++;
+    if (mem_root.deferred_count && mem_coalesce_mode == MEM_COALESCE_DEFERRED) {
+        coalesce_quick(&mem_root, mem_maint_config.refill ? mem_quick_target : NULL);
+        mem_maint_stats.coalesces++;
+    }
+    mem_maint_frees = 0;
+
+    if (mem_maint_config.refill && mem_coalesce_mode == MEM_COALESCE_DEFERRED && !mem_region_depth)
+        refill_quick_lists();
+
+    if (mem_alloc_events != *last_events) {
+        *last_events = mem_alloc_events;
+        *idle_since = now;
+    } else if (mem_maint_config.trim_idle_ms && *idle_since &&
+               now - *idle_since >= (uint64_t)mem_maint_config.trim_idle_ms * 1000000ull) {
+        mem_maint_stats.trimmed_bytes += trim_locked();
+        *idle_since = 0;  // Trim once per idle period
+    }
+}
+
+/**
+ * @brief Body of the maintenance thread.
+ *
+ * Sleeps interval_ms between passes, or until wake_frees deferred frees have
+ * accumulated. After a pass that took t, the next pass is held back so that
+ * maintenance uses at most duty_percent of the time: the sleep is at least
+ * t * (100 - duty_percent) / duty_percent.
+ */
+static void* maintenance_main(void* arg) {
+    (void)arg;
+    uint64_t idle_since = monotonic_ns();
+    uint64_t last_events = 0;
+
+    pthread_mutex_lock(&mem_lock);
+    while (!mem_maint_stop) {
+        uint64_t start = monotonic_ns();
+        if (mem_root.base) maintenance_pass(start, &idle_since, &last_events);
+        uint64_t now = monotonic_ns();
+
+        // Early wake-ups may not come before earliest; the timer fires at deadline
+        uint64_t duty_sleep = (now - start) * (100 - mem_maint_config.duty_percent) / mem_maint_config.duty_percent;
+        uint64_t interval = (uint64_t)mem_maint_config.interval_ms * 1000000ull;
+        uint64_t earliest = now + duty_sleep;
+        uint64_t deadline = now + (duty_sleep > interval ? duty_sleep : interval);
+
+        while (!mem_maint_stop && now < deadline) {
+            int woken = mem_maint_config.wake_frees && mem_maint_frees >= mem_maint_config.wake_frees;
+            if (woken && now >= earliest) break;
+
+            uint64_t until = woken ? earliest : deadline;
+            struct timespec ts = { (time_t)(until / 1000000000ull), (long)(until % 1000000000ull) };
+            pthread_cond_timedwait(&mem_maint_cond, &mem_lock, &ts);
+            now = monotonic_ns();
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return NULL;
+}
+
+/**
+ * @brief Start a background thread that keeps housekeeping off the request path.
+ *
+ * While it runs every public function takes an internal mutex, so the memory
+ * manager may also be shared by several threads. Configuration calls
+ * (mem_set_policy, mem_set_frag_policy) are not synchronized and should be
+ * made before the thread is started. Deferred coalescing with a threshold of
+ * 0 leaves all merging to the thread.
+ *
+ * @param config Duty cycle and wake-up conditions; NULL uses the defaults
+ *        (10 ms interval, 25% duty cycle, no early wake-up, no refill, trim
+ *        after 100 ms without allocations).
+ * @return 0 on success, -1 if the pool is not initialized, the thread already
+ *         runs, the configuration is invalid or the thread cannot be created.
+ */
+int mem_maintenance_start(const MemMaintenanceConfig* config) {
+    MemMaintenanceConfig defaults = { 10, 25, 0, 0, 100 };
+    if (!config) config = &defaults;
+    if (!mem_root.base || mem_maint_running) return -1;
+    if (config->duty_percent == 0 || config->duty_percent > 100) return -1;
+
+    mem_maint_config = *config;
+    mem_maint_stop = 0;
+    mem_maint_frees = 0;
+    memset(mem_quick_misses, 0, sizeof(mem_quick_misses));
+    memset(mem_quick_used, 0, sizeof(mem_quick_used));
+    memset(mem_quick_target, 0, sizeof(mem_quick_target));
+    memset(&mem_maint_stats, 0, sizeof(mem_maint_stats));
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int failed = pthread_cond_init(&mem_maint_cond, &attr) != 0;
+    pthread_condattr_destroy(&attr);
+    if (failed) return -1;
+
+    mem_maint_running = 1;
+    mem_locking = 1;
+    if (pthread_create(&mem_maint_thread, NULL, maintenance_main, NULL) != 0) {
+        mem_maint_running = 0;
+        mem_locking = mem_thread_safe;
+        memset(&mem_maint_config, 0, sizeof(mem_maint_config));
+        pthread_cond_destroy(&mem_maint_cond);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop the maintenance thread and wait for it to exit.
+ *
+ * Unless thread-safe mode is on, the public functions stop taking the internal
+ * mutex afterwards, so no other thread may be using the memory manager then.
+ */
+void mem_maintenance_stop(void) {
+    if (!mem_maint_running) return;
+
+    pthread_mutex_lock(&mem_lock);
+    mem_maint_stop = 1;
+    pthread_cond_signal(&mem_maint_cond);
+    pthread_mutex_unlock(&mem_lock);
+    pthread_join(mem_maint_thread, NULL);
+    pthread_cond_destroy(&mem_maint_cond);
+
+    mem_maint_running = 0;
+    mem_locking = mem_thread_safe;
+    memset(&mem_maint_config, 0, sizeof(mem_maint_config));
+}
+
+/**
+ * @brief Report what the maintenance thread has done since it was started.
+ *
+ * @param stats Output structure; left over from the last run once stopped.
+ */
+void mem_maintenance_stats(MemMaintenanceStats* stats) {
+    if (!stats) return;
+    lock_pool();
+    *stats = mem_maint_stats;
+    unlock_pool();
+}
+
+/**
+ * @brief Make every public function take the internal mutex.
+ *
+ * Needed when several threads share the pool without the maintenance thread,
+ * for example through the per-thread caches of memory_manager_inline.h.
+ * Must be switched while no other thread uses the memory manager.
+ */
+void mem_set_thread_safe(int enabled) {
+    mem_thread_safe = enabled != 0;
+    mem_locking = mem_thread_safe || mem_maint_running;
+}
+
+/** Per-thread size-class caches used by the inline fast path */
+__thread MemThreadCache mem_tcache;
+
+/**
+ * Bumped by mem_init and mem_deinit. A thread cache filled under an older
+ * generation points into a pool that no longer exists and is dropped.
+ */
+uint64_t mem_tcache_generation = 0;
+
+/**
+ * @struct MemRemoteList
+ * @brief Blocks freed by other threads to the thread in one owner slot.
+ *
+ * Foreign threads push with a CAS; the owner takes the whole list with one
+ * exchange, so no pop ever races a push and the stack needs no ABA tag. Each
+ * list sits on its own cache line so pushes to different owners do not
+ * contend.
+ *
+ * @var head Last block pushed, linked through MemTCacheHeader.next.
+ * @var taken Non-zero while a thread holds the slot.
+ */
+typedef struct {
+    MemTCacheHeader* head;
+    uint32_t taken;
+} __attribute__((aligned(64))) MemRemoteList;
+
+/** Remote-free list of every owner slot, indexed by MemThreadCache.owner - 1 */
+static MemRemoteList mem_remote[MEM_TCACHE_OWNERS];
+
+/** Destructor key that flushes a thread's cache when the thread exits */
+static pthread_key_t mem_tcache_key;
+static pthread_once_t mem_tcache_key_once = PTHREAD_ONCE_INIT;
+
+static void tcache_thread_exit(void* arg) {
+    (void)arg;
+    uint32_t owner = mem_tcache.owner;
+    if (owner) __atomic_store_n(&mem_remote[owner - 1].taken, 0, __ATOMIC_RELEASE);
+    mem_tcache_flush();  // Blocks pushed after this wait for the slot's next owner
+    mem_tcache.owner = 0;
+}
+
+static void tcache_key_create(void) {
+    pthread_key_create(&mem_tcache_key, tcache_thread_exit);
+}
+
+/**
+ * @brief Forget a stale cache and adopt the current pool generation.
+ */
+static void tcache_adopt(void) {
+    if (mem_tcache.generation == mem_tcache_generation) return;
+    uint32_t owner = mem_tcache.owner;  // The slot outlives the pool
+    memset(&mem_tcache, 0, sizeof(mem_tcache));
+    mem_tcache.generation = mem_tcache_generation;
+    mem_tcache.owner = owner;
+}
+
+/**
+ * @brief Give the calling thread a free owner slot, so its blocks carry an owner.
+ *
+ * Without a slot (all MEM_TCACHE_OWNERS are held) blocks are ownerless and a
+ * foreign free caches them on the freeing thread, as without remote lists.
+ */
+static void tcache_claim_owner(void) {
+    for (uint32_t slot = 0; slot < MEM_TCACHE_OWNERS; slot++) {
+        uint32_t expected = 0;
+        if (__atomic_load_n(&mem_remote[slot].taken, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&mem_remote[slot].taken, &expected, 1, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            mem_tcache.owner = slot + 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Move the blocks other threads freed to this thread into its cache.
+ *
+ * Classes that are full send their surplus back to the pool under one lock
+ * acquisition.
+ *
+ * @return Number of blocks taken off the remote list.
+ */
+static size_t tcache_drain_remote(void) {
+    if (!mem_tcache.owner) return 0;
+    MemTCacheHeader* list = __atomic_exchange_n(&mem_remote[mem_tcache.owner - 1].head, NULL, __ATOMIC_ACQUIRE);
+
+    size_t drained = 0;
+    MemTCacheHeader* surplus = NULL;
+    while (list) {
+        MemTCacheHeader* obj = list;
+        list = obj->next;
+        drained++;
+        uint32_t size_class = obj->size_class;
+        if (mem_tcache.count[size_class] < MEM_TCACHE_LIMIT) {
+            obj->next = mem_tcache.head[size_class];
+            mem_tcache.head[size_class] = obj;
+            mem_tcache.count[size_class]++;
+        } else {
+            obj->next = surplus;
+            surplus = obj;
+        }
+    }
+    if (surplus) {
+        lock_pool();
+        while (surplus) {
+            MemTCacheHeader* obj = surplus;
+            surplus = obj->next;
+            free_locked(&mem_root, obj);
+        }
+        unlock_pool();
+    }
+    return drained;
+}
+
+/**
+ * @brief Take a block of at least size bytes that starts on a MEM_TCACHE_GRANULE
+ *        boundary, whatever other allocations did to the pool; the caller holds
+ *        the pool lock.
+ *
+ * Like the small-block region, the block is taken MEM_TCACHE_GRANULE - 1 bytes
+ * larger. Cached blocks go back to the pool one by one by their own address,
+ * so a misaligned start is cut off as a block of its own and freed at once
+ * rather than skipped.
+ *
+ * @return The allocated, indexed block, or NULL if the pool is full.
+ */
+static MemBlock* tcache_take(size_t size) {
+    if (!mem_root.base || size > SIZE_MAX - MEM_TCACHE_GRANULE) return NULL;
+    char* ptr = block_alloc(&mem_root, size + MEM_TCACHE_GRANULE - 1, 0);  // Never from a region
+    if (!ptr) return NULL;
+
+    MemBlock* block = index_find(&mem_root, ptr - mem_root.base);
+    size_t pad = (size_t)(-(uintptr_t)ptr & (MEM_TCACHE_GRANULE - 1));
+    if (pad) {
+        MemBlock* rest = index_reserve(&mem_root) == 0 ? split_block(&mem_root, block, pad) : NULL;
+        if (!rest) {
+            free_locked(&mem_root, ptr);
+            return NULL;
+        }
+        rest->is_block_free = 0;
+        table_sync(&mem_root, rest);
+        index_insert(&mem_root, rest);
+        free_locked(&mem_root, ptr);
+        block = rest;
+    }
+    return block;
+}
+
+/**
+ * @brief Allocate a block with a thread-cache header; the caller holds the pool lock.
+ */
+static MemTCacheHeader* tcache_block(size_t size, uint32_t size_class) {
+    MemBlock* block = tcache_take(size + MEM_TCACHE_HEADER);
+    if (!block) return NULL;
+
+    MemTCacheHeader* obj = (MemTCacheHeader*)(mem_root.base + block->offset);
+    obj->size_class = size_class;
+    obj->owner = mem_tcache.owner;
+    obj->next = NULL;
+    return obj;
+}
+
+/**
+ * @brief Refill an empty class with up to MEM_TCACHE_BATCH blocks carved from one chunk.
+ *
+ * A single search finds room for the whole batch, which is then split into
+ * separate allocated blocks, so a refill costs one list walk rather than one
+ * per block. The chunk starts on a granule (see tcache_take) and the stride is
+ * whole granules, so every block is 16-byte aligned. The caller holds the
+ * pool lock.
+ *
+ * @return One block of the class for the caller; the rest go on the cache.
+ */
+static MemTCacheHeader* tcache_refill(uint32_t size_class) {
+    size_t stride = (size_t)(size_class + 1) * MEM_TCACHE_GRANULE + MEM_TCACHE_HEADER;
+    MemBlock* block = tcache_take(stride * MEM_TCACHE_BATCH);
+    if (!block) return tcache_block(stride - MEM_TCACHE_HEADER, size_class);
+
+    MemTCacheHeader* first = (MemTCacheHeader*)(mem_root.base + block->offset);
+    for (int k = 0; k < MEM_TCACHE_BATCH; k++) {
+        MemTCacheHeader* obj = (MemTCacheHeader*)(mem_root.base + block->offset);
+        obj->size_class = size_class;
+        obj->owner = mem_tcache.owner;
+        obj->next = NULL;
+        if (obj != first) {
+            obj->next = mem_tcache.head[size_class];
+            mem_tcache.head[size_class] = obj;
+            mem_tcache.count[size_class]++;
+        }
+
+        // Cut the next block off the rest of the chunk
+        if (k + 1 == MEM_TCACHE_BATCH || block->size < 2 * stride || index_reserve(&mem_root) != 0) break;
+        MemBlock* rest = split_block(&mem_root, block, stride);
+        if (!rest) break;
+        rest->is_block_free = 0;
+        table_sync(&mem_root, rest);
+        index_insert(&mem_root, rest);
+        block = rest;
+    }
+    return first;
+}
+
+/**
+ * @brief Slow path of mem_alloc_inline: refill an empty class or allocate a large block.
+ *
+ * Blocks that other threads freed to this one are drained first; if that
+ * refills the class no lock is taken. Otherwise the class is refilled under
+ * a single lock acquisition (see tcache_refill). Larger requests get a block
+ * tagged MEM_TCACHE_LARGE that mem_free_inline hands straight back to the pool.
+ */
+void* mem_tcache_alloc_slow(size_t size) {
+    if (size > SIZE_MAX - MEM_TCACHE_HEADER - MEM_TCACHE_GRANULE) return NULL;
+    tcache_adopt();
+    if (!mem_tcache.owner) tcache_claim_owner();
+
+    MemTCacheHeader* obj;
+    if (size - 1 < MEM_TCACHE_MAX_SIZE && tcache_drain_remote()) {
+        size_t size_class = (size - 1) / MEM_TCACHE_GRANULE;
+        obj = mem_tcache.head[size_class];
+        if (obj) {
+            mem_tcache.head[size_class] = obj->next;
+            mem_tcache.count[size_class]--;
+            return (char*)obj + MEM_TCACHE_HEADER;
+        }
+    }
+
+    lock_pool();
+    if (size == 0 || size > MEM_TCACHE_MAX_SIZE) {
+        obj = tcache_block(size, MEM_TCACHE_LARGE);
+    } else {
+        obj = tcache_refill((uint32_t)((size - 1) / MEM_TCACHE_GRANULE));
+    }
+    unlock_pool();
+
+    pthread_once(&mem_tcache_key_once, tcache_key_create);
+    pthread_setspecific(mem_tcache_key, &mem_tcache);
+    return obj ? (char*)obj + MEM_TCACHE_HEADER : NULL;
+}
+
+/**
+ * @brief Slow path of mem_free_inline: foreign blocks, large blocks and full classes.
+ *
+ * A cached-size block owned by another thread is pushed onto the owner's
+ * remote-free list without taking the pool lock. A full class gives half of
+ * its blocks back to the pool under one lock acquisition before the freed
+ * block is cached.
+ */
+void mem_tcache_free_slow(MemTCacheHeader* obj) {
+    uint32_t size_class = obj->size_class;
+    tcache_adopt();
+
+    if (size_class < MEM_TCACHE_CLASSES && obj->owner && obj->owner != mem_tcache.owner) {
+        MemRemoteList* remote = &mem_remote[obj->owner - 1];
+        obj->next = __atomic_load_n(&remote->head, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&remote->head, &obj->next, obj, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+        return;
+    }
+
+    lock_pool();
+    if (size_class >= MEM_TCACHE_CLASSES) {
+        free_locked(&mem_root, obj);
+    } else {
+        while (mem_tcache.count[size_class] > MEM_TCACHE_LIMIT / 2) {
+            MemTCacheHeader* cached = mem_tcache.head[size_class];
+            mem_tcache.head[size_class] = cached->next;
+            mem_tcache.count[size_class]--;
+            free_locked(&mem_root, cached);
+        }
+        obj->next = mem_tcache.head[size_class];
+        mem_tcache.head[size_class] = obj;
+        mem_tcache.count[size_class]++;
+    }
+    unlock_pool();
+}
+
+/**
+ * @brief Return every block cached by the calling thread, and every block
+ *        other threads freed to it, to the pool.
+ *
+ * Runs automatically when a thread that used the inline fast path exits.
+ */
+void mem_tcache_flush(void) {
+    if (mem_tcache.generation != mem_tcache_generation) {
+        tcache_adopt();  // The pool these blocks came from is gone
+        return;
+    }
+
+    MemTCacheHeader* remote = NULL;
+    if (mem_tcache.owner) remote = __atomic_exchange_n(&mem_remote[mem_tcache.owner - 1].head, NULL, __ATOMIC_ACQUIRE);
+    lock_pool();
+    while (remote) {
+        MemTCacheHeader* obj = remote;
+        remote = obj->next;
+        free_locked(&mem_root, obj);
+    }
+    for (int size_class = 0; size_class < MEM_TCACHE_CLASSES; size_class++) {
+        while (mem_tcache.head[size_class]) {
+            MemTCacheHeader* cached = mem_tcache.head[size_class];
+            mem_tcache.head[size_class] = cached->next;
+            free_locked(&mem_root, cached);
+        }
+        mem_tcache.count[size_class] = 0;
+    }
+    unlock_pool();
+}
+
+/**
+ * @struct MemTlabBuffer
+ * @brief Header at the start of every TLAB buffer, in the pool.
+ *
+ * The pool is byte-granular, so a buffer's block is taken MEM_TLAB_ALIGN - 1
+ * bytes larger and the header starts at the first aligned address in it.
+ *
+ * @var next Next buffer on the retired list.
+ * @var stamp Last epoch any object in the buffer was allocated in.
+ * @var block Start of the buffer's block, which mem_epoch_advance frees.
+ */
+typedef struct MemTlabBuffer {
+    struct MemTlabBuffer* next;
+    uint64_t stamp;
+    char* block;
+} MemTlabBuffer;
+
+/** Bytes in front of the first object of a buffer; keeps objects MEM_TLAB_ALIGN-aligned */
+#define MEM_TLAB_HEADER ((sizeof(MemTlabBuffer) + MEM_TLAB_ALIGN - 1) & ~(size_t)(MEM_TLAB_ALIGN - 1))
+
+/**
+ * @struct MemEpochPin
+ * @brief Pin slot of one thread, on its own cache line.
+ *
+ * @var epoch Epoch the thread entered its section with, 0 while it is outside one.
+ * @var taken Non-zero while a thread holds the slot.
+ */
+typedef struct {
+    uint64_t epoch;
+    uint32_t taken;
+} __attribute__((aligned(64))) MemEpochPin;
+
+__thread MemTlab mem_tlab;
+
+/** Global epoch; starts at 1 so that a pin of 0 means "not pinned" */
+static uint64_t mem_epoch = 1;
+
+/** Buffers stamped below this epoch hold no live object (set by mem_epoch_advance) */
+static uint64_t mem_epoch_safe = 0;
+
+/** Pin slot of every thread using TLABs, indexed by MemTlab.slot - 1 */
+static MemEpochPin mem_epoch_pins[MEM_TLAB_THREADS];
+
+/** Full buffers waiting for the epoch to move past their stamp; guarded by the pool lock */
+static MemTlabBuffer* mem_tlab_retired = NULL;
+
+/** Destructor key that releases a thread's pin slot and buffer when the thread exits */
+static pthread_key_t mem_tlab_key;
+static pthread_once_t mem_tlab_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Put a buffer on the retired list; the caller holds the pool lock.
+ */
+static void tlab_retire(MemTlabBuffer* buffer) {
+    buffer->next = mem_tlab_retired;
+    mem_tlab_retired = buffer;
+}
+
+static void tlab_thread_exit(void* arg) {
+    (void)arg;
+    if (mem_tlab.buffer && mem_tlab.generation == mem_tcache_generation) {
+        lock_pool();
+        tlab_retire(mem_tlab.buffer);
+        unlock_pool();
+    }
+    if (mem_tlab.slot) {
+        __atomic_store_n(&mem_epoch_pins[mem_tlab.slot - 1].epoch, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&mem_epoch_pins[mem_tlab.slot - 1].taken, 0, __ATOMIC_RELEASE);
+    }
+    memset(&mem_tlab, 0, sizeof(mem_tlab));
+}
+
+static void tlab_key_create(void) {
+    pthread_key_create(&mem_tlab_key, tlab_thread_exit);
+}
+
+/**
+ * @brief Forget a buffer of a pool that no longer exists, keeping the pin.
+ */
+static void tlab_adopt(void) {
+    if (mem_tlab.generation == mem_tcache_generation) return;
+    mem_tlab.cursor = mem_tlab.limit = NULL;
+    mem_tlab.buffer = NULL;
+    mem_tlab.generation = mem_tcache_generation;
+}
+
+/**
+ * @brief Pin the global epoch for the calling thread.
+ *
+ * The thread claims a pin slot on first use. The epoch is re-read after the
+ * pin is published, so an advance that missed the pin cannot have moved the
+ * epoch past it. If the thread's current buffer is older than the last safe
+ * epoch, every object in it is dead and the buffer is reused from the start.
+ *
+ * @return 0 on success, -1 if all MEM_TLAB_THREADS pin slots are held.
+ */
+int mem_tlab_begin(void) {
+    tlab_adopt();
+    if (!mem_tlab.slot) {
+        for (uint32_t slot = 0; slot < MEM_TLAB_THREADS && !mem_tlab.slot; slot++) {
+            uint32_t expected = 0;
+            if (__atomic_compare_exchange_n(&mem_epoch_pins[slot].taken, &expected, 1, 0, __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED))
+                mem_tlab.slot = slot + 1;
+        }
+        if (!mem_tlab.slot) return -1;
+        pthread_once(&mem_tlab_key_once, tlab_key_create);
+        pthread_setspecific(mem_tlab_key, &mem_tlab);
+    }
+
+    MemEpochPin* pin = &mem_epoch_pins[mem_tlab.slot - 1];
+    uint64_t epoch;
+    do {
+        epoch = __atomic_load_n(&mem_epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&pin->epoch, epoch, __ATOMIC_SEQ_CST);
+    } while (__atomic_load_n(&mem_epoch, __ATOMIC_SEQ_CST) != epoch);
+    mem_tlab.pinned = epoch;
+
+    MemTlabBuffer* buffer = mem_tlab.buffer;
+    if (buffer) {
+        if (buffer->stamp < __atomic_load_n(&mem_epoch_safe, __ATOMIC_ACQUIRE))
+            mem_tlab.cursor = (char*)buffer + MEM_TLAB_HEADER;
+        mem_tlab.limit = (char*)buffer + MEM_TLAB_SIZE;
+        buffer->stamp = epoch;
+    }
+    return 0;
+}
+
+/**
+ * @brief Unpin the calling thread.
+ *
+ * The buffer is closed (limit = cursor) so mem_tlab_alloc outside a section
+ * takes the slow path and fails; mem_tlab_begin reopens it.
+ */
+void mem_tlab_end(void) {
+    if (!mem_tlab.slot) return;
+    __atomic_store_n(&mem_epoch_pins[mem_tlab.slot - 1].epoch, 0, __ATOMIC_RELEASE);
+    mem_tlab.pinned = 0;
+    mem_tlab.limit = mem_tlab.cursor;
+}
+
+/**
+ * @brief Slow path of mem_tlab_alloc: start a new buffer or serve a large request.
+ *
+ * Requests over a quarter of MEM_TLAB_SIZE get a buffer of their own, which
+ * is retired at once; otherwise the full buffer is retired and a fresh one
+ * taken from the pool. Both happen under one lock acquisition.
+ *
+ * @return The object, or NULL outside a pinned section or if the pool is full.
+ */
+void* mem_tlab_alloc_slow(size_t size) {
+    tlab_adopt();
+    if (!mem_tlab.pinned || size == 0 || size > SIZE_MAX - MEM_TLAB_HEADER - MEM_TLAB_ALIGN) return NULL;
+    size_t rounded = (size + MEM_TLAB_ALIGN - 1) & ~(size_t)(MEM_TLAB_ALIGN - 1);
+    int dedicated = rounded > MEM_TLAB_SIZE / 4;
+
+    lock_pool();
+    MemTlabBuffer* buffer = NULL;
+    char* block = NULL;
+    if (mem_root.base) {  // Never from a region, which would free it under the TLAB
+        size_t size = (dedicated ? MEM_TLAB_HEADER + rounded : MEM_TLAB_SIZE) + MEM_TLAB_ALIGN - 1;
+        block = block_alloc(&mem_root, size, 0);
+    }
+    if (block) {
+        buffer = (MemTlabBuffer*)(((uintptr_t)block + MEM_TLAB_ALIGN - 1) & ~(uintptr_t)(MEM_TLAB_ALIGN - 1));
+        buffer->block = block;
+        buffer->stamp = mem_tlab.pinned;
+        if (dedicated) {
+            tlab_retire(buffer);
+        } else {
+            if (mem_tlab.buffer) tlab_retire(mem_tlab.buffer);
+            mem_tlab.buffer = buffer;
+            mem_tlab.cursor = (char*)buffer + MEM_TLAB_HEADER + rounded;
+            mem_tlab.limit = (char*)buffer + MEM_TLAB_SIZE;
+        }
+    }
+    unlock_pool();
+    return buffer ? (char*)buffer + MEM_TLAB_HEADER : NULL;
+}
+
+/**
+ * @brief Advance the global epoch and free every retired buffer nobody can use.
+ *
+ * The safe epoch is the new epoch, or the oldest epoch a thread is pinned at
+ * if that is lower. Retired buffers stamped below it go back to the pool, and
+ * threads rewind current buffers stamped below it on their next mem_tlab_begin.
+ *
+ * @return The new epoch.
+ */
+uint64_t mem_epoch_advance(void) {
+    lock_pool();
+    uint64_t epoch = __atomic_add_fetch(&mem_epoch, 1, __ATOMIC_SEQ_CST);
+    uint64_t safe = epoch;
+    for (int slot = 0; slot < MEM_TLAB_THREADS; slot++) {
+        uint64_t pinned = __atomic_load_n(&mem_epoch_pins[slot].epoch, __ATOMIC_SEQ_CST);
+        if (pinned && pinned < safe) safe = pinned;
+    }
+    __atomic_store_n(&mem_epoch_safe, safe, __ATOMIC_RELEASE);
+
+    MemTlabBuffer** link = &mem_tlab_retired;
+    while (*link) {
+        MemTlabBuffer* buffer = *link;
+        if (buffer->stamp < safe) {
+            *link = buffer->next;
+            free_locked(&mem_root, buffer->block);
+        } else {
+            link = &buffer->next;
+        }
+    }
+    unlock_pool();
+    return epoch;
+}
+
+// Deinitialize memory pool, releasing all memory. Runs in constant time apart
+// from the child pools: the pool and the metadata arena are each one munmap,
+// and the block nodes one per node chunk, a count that grows only
+// logarithmically with the blocks. Child pools are destroyed with it.
+void mem_deinit() {
+    mem_maintenance_stop();
+    mem_tcache_generation++;
+    for (int owner = 0; owner < MEM_TCACHE_OWNERS; owner++) mem_remote[owner].head = NULL;  // Blocks of the old pool
+    mem_tlab_retired = NULL;
+    if (mem_root.base) munmap(mem_root.base, mem_root.size ? mem_root.size : 1);
+    if (mem_pool_fd >= 0) close(mem_pool_fd);
+    mem_pool_fd = -1;
+    meta_arena_release();
+    small_release(0);
+    bag_release(0);
+
+    while (mem_root.children) {
+        MemPool* child = mem_root.children;
+        mem_root.children = child->next_sibling;
+        pool_drop(child, 0);  // Their nodes went with the arena
+    }
+    free(mem_root.block_index);
+    free(mem_root.table_offset);
+    free(mem_root.table_fit);
+    free(mem_root.table_block);
+    memset(&mem_root, 0, sizeof(mem_root));
+
+    free(mem_handles);
+    mem_handles = NULL;
+    mem_handle_capacity = 0;
+    mem_handle_free_list = 0;
+
+    mem_region_block = NULL;
+    mem_region_depth = 0;
+    free(mem_region_starts);
+    mem_region_starts = NULL;
+    mem_region_count = 0;
+    mem_region_capacity = 0;
+}
+
+/** MemSharedHeader.magic of an initialized shared heap */
+#define MEM_SHARED_MAGIC 0x4D454D5348415245ull
+
+/** Low bit of MemSharedBlock.size, set while the block is free */
+#define MEM_SHARED_FREE 1ull
+
+/** Block sizes and payloads are multiples of this */
+#define MEM_SHARED_ALIGN 16
+
+/** Metadata words one operation may change; a free that merges both neighbours changes 14 */
+#define MEM_SHARED_JOURNAL 32
+
+/**
+ * @struct MemSharedHeader
+ * @brief Start of a shared heap's mapping; every process sees the same bytes.
+ *
+ * Nothing in the mapping holds a pointer: blocks are linked by their offset
+ * from the start of the mapping, so each process may map it at a different
+ * address, and a file-backed heap can be mapped again after a restart.
+ * Offset 0 is the header itself and never a block.
+ *
+ * @var magic MEM_SHARED_MAGIC once the creator has finished initializing.
+ * @var size Bytes in the mapping.
+ * @var lock Process-shared, robust mutex serializing every operation.
+ * @var free_head Offset of the first block on the free list, 0 if none.
+ * @var root Offset the application stores its entry point under, 0 if none.
+ * @var journal_count Entries of journal written by the operation in progress, 0 between operations.
+ * @var journal Undo log: offset and previous value of each metadata word the operation changed.
+ */
+typedef struct {
+    uint64_t magic;
+    uint64_t size;
+    pthread_mutex_t lock;
+    uint64_t free_head;
+    uint64_t root;
+    uint64_t journal_count;
+    struct {
+        uint64_t offset;
+        uint64_t value;
+    } journal[MEM_SHARED_JOURNAL];
+} MemSharedHeader;
+
+/**
+ * @struct MemSharedBlock
+ * @brief Header in front of every block of a shared heap.
+ *
+ * The next block starts size bytes further on. A free block keeps its
+ * free-list links (offsets, 0 = none) in its first payload bytes.
+ *
+ * @var size Bytes in the block, header included, with MEM_SHARED_FREE or'ed in while free.
+ * @var prev Offset of the block just before this one, 0 for the first block.
+ * @var next_free Next free block (free blocks only).
+ * @var prev_free Previous free block (free blocks only).
+ */
+typedef struct {
+    uint64_t size;
+    uint64_t prev;
+    uint64_t next_free;
+    uint64_t prev_free;
+} MemSharedBlock;
+
+/** Bytes in front of every payload */
+#define MEM_SHARED_HEADER (2 * sizeof(uint64_t))
+
+/** Offset of the first block */
+#define MEM_SHARED_FIRST ((sizeof(MemSharedHeader) + MEM_SHARED_ALIGN - 1) & ~(size_t)(MEM_SHARED_ALIGN - 1))
+
+/**
+ * @struct MemShared
+ * @brief One process's handle on a shared heap.
+ */
+struct MemShared {
+    char* base;     /**< This process's mapping */
+    size_t size;    /**< Bytes in the mapping */
+    int fd;         /**< Shared memory object or memfd behind the mapping */
+};
+
+static MemSharedBlock* shared_block(MemShared* heap, uint64_t offset) {
+    return (MemSharedBlock*)(heap->base + offset);
+}
+
+/**
+ * @brief Change one metadata word of the heap, journaling its old value first.
+ *
+ * The journal entry is complete before the count covers it, and the count
+ * covers it before the word changes, so a crash at any store leaves a journal
+ * that undoes exactly the changes made.
+ */
+static void shared_set(MemShared* heap, uint64_t* field, uint64_t value) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    uint64_t count = header->journal_count;
+    header->journal[count].offset = (uint64_t)((char*)field - heap->base);
+    header->journal[count].value = *field;
+    __atomic_store_n(&header->journal_count, count + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(field, value, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Undo the operation a crash cut short, newest change first.
+ *
+ * Entries pointing outside the heap (a damaged file) are skipped.
+ */
+static void shared_rollback(MemShared* heap) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    uint64_t count = header->journal_count;
+    if (count > MEM_SHARED_JOURNAL) count = MEM_SHARED_JOURNAL;
+    while (count > 0) {
+        count--;
+        uint64_t offset = header->journal[count].offset;
+        if (offset % sizeof(uint64_t) == 0 && offset <= heap->size - sizeof(uint64_t))
+            *(uint64_t*)(heap->base + offset) = header->journal[count].value;
+    }
+    __atomic_store_n(&header->journal_count, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Take the heap's lock, recovering it if its holder died.
+ *
+ * A robust mutex whose owner exited reports EOWNERDEAD; the dead holder's
+ * half-done operation is rolled back from the journal, after which the lock
+ * is marked consistent and reused.
+ */
+static void shared_lock(MemShared* heap) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) {
+        shared_rollback(heap);
+        pthread_mutex_consistent(&header->lock);
+    }
+}
+
+/**
+ * @brief Commit the operation by emptying the journal, then release the lock.
+ */
+static void shared_unlock(MemShared* heap) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    __atomic_store_n(&header->journal_count, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&header->lock);
+}
+
+static void shared_push_free(MemShared* heap, uint64_t offset) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    MemSharedBlock* block = shared_block(heap, offset);
+    shared_set(heap, &block->size, block->size | MEM_SHARED_FREE);
+    shared_set(heap, &block->prev_free, 0);
+    shared_set(heap, &block->next_free, header->free_head);
+    if (header->free_head) shared_set(heap, &shared_block(heap, header->free_head)->prev_free, offset);
+    shared_set(heap, &header->free_head, offset);
+}
+
+static void shared_unlink_free(MemShared* heap, uint64_t offset) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    MemSharedBlock* block = shared_block(heap, offset);
+    if (block->prev_free) shared_set(heap, &shared_block(heap, block->prev_free)->next_free, block->next_free);
+    else shared_set(heap, &header->free_head, block->next_free);
+    if (block->next_free) shared_set(heap, &shared_block(heap, block->next_free)->prev_free, block->prev_free);
+    shared_set(heap, &block->size, block->size & ~MEM_SHARED_FREE);
+}
+
+/**
+ * @brief Initialize the lock of a heap nobody else has mapped.
+ */
+static void shared_init_lock(MemSharedHeader* header) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Round a requested heap size up to whole pages; 0 if it is too small or too large.
+ */
+static size_t shared_heap_size(size_t size) {
+    if (size <= MEM_SHARED_FIRST + sizeof(MemSharedBlock) || size > SIZE_MAX - mem_page_size) return 0;
+    return (size + mem_page_size - 1) / mem_page_size * mem_page_size;
+}
+
+/**
+ * @brief Lay out a new heap over a zero-filled mapping as one free block.
+ *
+ * The magic is stored last, so a mapping without it was never handed out.
+ */
+static void shared_format(MemShared* heap) {
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    shared_init_lock(header);
+    header->size = heap->size;
+
+    MemSharedBlock* first = shared_block(heap, MEM_SHARED_FIRST);
+    first->size = heap->size - MEM_SHARED_FIRST;
+    first->prev = 0;
+    shared_push_free(heap, MEM_SHARED_FIRST);
+    header->journal_count = 0;
+    __atomic_store_n(&header->magic, MEM_SHARED_MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Map a shared heap behind fd and check that it is initialized.
+ *
+ * @return A handle owning fd, or NULL (fd is then closed).
+ */
+static MemShared* shared_map(int fd) {
+    struct stat st;
+    MemShared* heap = fd >= 0 ? calloc(1, sizeof(MemShared)) : NULL;
+    if (heap && fstat(fd, &st) == 0 && (size_t)st.st_size > MEM_SHARED_FIRST) {
+        heap->size = (size_t)st.st_size;
+        heap->base = mmap(NULL, heap->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (heap->base == MAP_FAILED) heap->base = NULL;
+    }
+    if (!heap || !heap->base) {
+        free(heap);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    heap->fd = fd;
+    return heap;
+}
+
+/**
+ * @brief Create a heap that several processes can map and allocate from.
+ *
+ * The heap's whole state, including its lock, lives in the mapping. Other
+ * processes attach by name with mem_shared_attach; a heap without a name is
+ * an anonymous memfd, shared with children across fork or by passing
+ * mem_shared_fd over a Unix socket.
+ *
+ * @param name shm_open name such as "/jobs" (must not exist yet), or NULL for a memfd.
+ * @param size Bytes in the mapping, rounded up to whole pages.
+ * @return A handle for this process, or NULL on failure.
+ */
+MemShared* mem_shared_create(const char* name, size_t size) {
+    size = shared_heap_size(size);
+    if (!size) return NULL;
+
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : memfd_create("mem_shared", MFD_CLOEXEC);
+    if (fd < 0) return NULL;  // Also when name exists: it belongs to another heap
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    MemShared* heap = shared_map(fd);
+    if (!heap) {
+        if (name) shm_unlink(name);
+        return NULL;
+    }
+    shared_format(heap);
+    return heap;
+}
+
+/**
+ * @brief Attach to a shared heap created under name by any process.
+ *
+ * @return A handle for this process, or NULL if the name is unknown or the heap is not initialized.
+ */
+MemShared* mem_shared_attach(const char* name) {
+    if (!name) return NULL;
+    MemShared* heap = shared_map(shm_open(name, O_RDWR, 0));
+    if (heap) {
+        MemSharedHeader* header = (MemSharedHeader*)heap->base;
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != MEM_SHARED_MAGIC || header->size != heap->size) {
+            mem_shared_detach(heap);
+            return NULL;
+        }
+    }
+    return heap;
+}
+
+/**
+ * @brief Create a persistent heap file at path, fully formatted before it appears.
+ *
+ * The heap is built in a temporary file next to path and linked into place,
+ * so a crash during creation never leaves a half-initialized heap under path.
+ *
+ * @return A handle holding the file's lock, or NULL on failure.
+ */
+static MemShared* persist_create(const char* path, size_t size) {
+    size = shared_heap_size(size);
+    char* temp = size ? malloc(strlen(path) + 8) : NULL;
+    if (!temp) return NULL;
+    sprintf(temp, "%s.XXXXXX", path);
+
+    int fd = mkostemp(temp, O_CLOEXEC);
+    if (fd < 0) {
+        free(temp);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0 || flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    MemShared* heap = shared_map(fd);
+    int linked = 0;
+    if (heap) {
+        shared_format(heap);
+        linked = fdatasync(heap->fd) == 0 && link(temp, path) == 0;
+    }
+    int lost_race = heap && !linked && errno == EEXIST;
+    unlink(temp);
+    free(temp);
+    if (heap && !linked) {
+        mem_shared_detach(heap);
+        // Another process created path first: open its heap instead
+        return lost_race ? mem_open(path, 0) : NULL;
+    }
+    return heap;
+}
+
+/**
+ * @brief Open the persistent heap in the file at path, creating it if needed.
+ *
+ * Reattaching maps the file and checks its header; blocks are only faulted in
+ * when touched, so a heap of any size is back in about the time of the mmap.
+ * The file's exclusive lock keeps other processes out while it is open.
+ *
+ * Every metadata change is journaled in the file and the journal is emptied
+ * as the operation completes. If a process dies part-way through, the next
+ * mem_open rolls the unfinished operation back, so the block list is always
+ * as before or after a whole allocation or free. That holds for process
+ * crashes; after a system crash only the state of the last mem_shared_sync is
+ * on disk, and pages the kernel wrote back since then may be from any point.
+ *
+ * @param path File holding the heap.
+ * @param size Bytes in a new heap (rounded up to whole pages); ignored when the file exists.
+ * @return A handle, or NULL if the file is not a heap, is open elsewhere, or cannot be created.
+ */
+MemShared* mem_open(const char* path, size_t size) {
+    if (!path) return NULL;
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? persist_create(path, size) : NULL;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    MemShared* heap = shared_map(fd);
+    if (heap) {
+        MemSharedHeader* header = (MemSharedHeader*)heap->base;
+        if (header->magic != MEM_SHARED_MAGIC || header->size != heap->size) {
+            mem_shared_detach(heap);
+            return NULL;
+        }
+        shared_init_lock(header);  // Whoever held it is gone
+        shared_rollback(heap);
+    }
+    return heap;
+}
+
+/**
+ * @brief Record offset (0 or a block of the heap) as the heap's root.
+ *
+ * @return 0 on success, -1 if offset is outside the heap.
+ */
+int mem_shared_set_root(MemShared* heap, size_t offset) {
+    if (!heap || (offset && (offset < MEM_SHARED_FIRST || offset >= heap->size))) return -1;
+    shared_lock(heap);
+    shared_set(heap, &((MemSharedHeader*)heap->base)->root, offset);
+    shared_unlock(heap);
+    return 0;
+}
+
+size_t mem_shared_root(MemShared* heap) {
+    return heap ? (size_t)__atomic_load_n(&((MemSharedHeader*)heap->base)->root, __ATOMIC_ACQUIRE) : 0;
+}
+
+/**
+ * @brief Write the whole mapping back to its file and wait for the disk.
+ *
+ * Only needed against system crashes: after a process crash the kernel still
+ * holds every write.
+ */
+int mem_shared_sync(MemShared* heap) {
+    if (!heap) return -1;
+    return msync(heap->base, heap->size, MS_SYNC) == 0 ? 0 : -1;
+}
+
+int mem_shared_fd(MemShared* heap) {
+    return heap ? heap->fd : -1;
+}
+
+/**
+ * @brief Allocate size bytes (16-byte aligned) from a shared heap, first fit.
+ *
+ * @return Pointer in this process's mapping, or NULL if no free block is large enough.
+ */
+void* mem_shared_alloc(MemShared* heap, size_t size) {
+    if (!heap || size == 0 || size > heap->size) return NULL;
+    uint64_t need = (size + MEM_SHARED_HEADER + MEM_SHARED_ALIGN - 1) & ~(uint64_t)(MEM_SHARED_ALIGN - 1);
+    if (need < sizeof(MemSharedBlock)) need = sizeof(MemSharedBlock);
+
+    shared_lock(heap);
+    MemSharedHeader* header = (MemSharedHeader*)heap->base;
+    uint64_t offset = header->free_head;
+    while (offset && (shared_block(heap, offset)->size & ~MEM_SHARED_FREE) < need)
+        offset = shared_block(heap, offset)->next_free;
+    if (!offset) {
+        shared_unlock(heap);
+        return NULL;
+    }
+
+    shared_unlink_free(heap, offset);
+    MemSharedBlock* block = shared_block(heap, offset);
+    if (block->size - need >= sizeof(MemSharedBlock)) {
+        // Split off the tail as a new free block
+        uint64_t rest = offset + need;
+        MemSharedBlock* tail = shared_block(heap, rest);
+        shared_set(heap, &tail->size, block->size - need);
+        shared_set(heap, &tail->prev, offset);
+        if (rest + tail->size < heap->size) shared_set(heap, &shared_block(heap, rest + tail->size)->prev, rest);
+        shared_set(heap, &block->size, need);
+        shared_push_free(heap, rest);
+    }
+    shared_unlock(heap);
+    return heap->base + offset + MEM_SHARED_HEADER;
+}
+
+/**
+ * @brief Free a block of a shared heap, merging it with free neighbours.
+ *
+ * Any process attached to the heap may free any block. Pointers that are not
+ * a live block (including double frees) are ignored.
+ */
+void mem_shared_free(MemShared* heap, void* ptr) {
+    if (!heap || !ptr) return;
+    uint64_t offset = (uint64_t)((char*)ptr - heap->base) - MEM_SHARED_HEADER;
+    if ((char*)ptr < heap->base + MEM_SHARED_FIRST + MEM_SHARED_HEADER || offset >= heap->size ||
+        offset % MEM_SHARED_ALIGN)
+        return;
+
+    shared_lock(heap);
+    MemSharedBlock* block = shared_block(heap, offset);
+    uint64_t size = block->size;
+    int live = !(size & MEM_SHARED_FREE) && size >= sizeof(MemSharedBlock) && size <= heap->size - offset &&
+               (offset + size == heap->size || shared_block(heap, offset + size)->prev == offset);
+    if (live) {
+        uint64_t next = offset + size;
+        if (next < heap->size && (shared_block(heap, next)->size & MEM_SHARED_FREE)) {
+            shared_unlink_free(heap, next);
+            shared_set(heap, &block->size, block->size + shared_block(heap, next)->size);
+        }
+        if (block->prev && (shared_block(heap, block->prev)->size & MEM_SHARED_FREE)) {
+            uint64_t prev = block->prev;
+            shared_unlink_free(heap, prev);
+            shared_set(heap, &shared_block(heap, prev)->size, shared_block(heap, prev)->size + block->size);
+            offset = prev;
+            block = shared_block(heap, prev);
+        }
+        if (offset + block->size < heap->size)
+            shared_set(heap, &shared_block(heap, offset + block->size)->prev, offset);
+        shared_push_free(heap, offset);
+    }
+    shared_unlock(heap);
+}
+
+/**
+ * @brief Offset of ptr in the heap, the form in which blocks are handed to other processes.
+ *
+ * @return The offset, or 0 if ptr is not inside this process's mapping.
+ */
+size_t mem_shared_offset(MemShared* heap, const void* ptr) {
+    if (!heap || (const char*)ptr < heap->base + MEM_SHARED_FIRST || (const char*)ptr >= heap->base + heap->size)
+        return 0;
+    return (size_t)((const char*)ptr - heap->base);
+}
+
+/**
+ * @brief Address of offset in this process's mapping; NULL for 0 or an offset outside the heap.
+ */
+void* mem_shared_ptr(MemShared* heap, size_t offset) {
+    if (!heap || offset < MEM_SHARED_FIRST || offset >= heap->size) return NULL;
+    return heap->base + offset;
+}
+
+/**
+ * @brief Fill stats with the layout of a shared heap, walking its blocks under the lock.
+ */
+void mem_shared_get_stats(MemShared* heap, MemStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(MemStats));
+    if (!heap) return;
+
+    shared_lock(heap);
+    stats->pool_size = heap->size - MEM_SHARED_FIRST;
+    stats->metadata_bytes = MEM_SHARED_FIRST;
+    for (uint64_t offset = MEM_SHARED_FIRST; offset < heap->size;) {
+        MemSharedBlock* block = shared_block(heap, offset);
+        uint64_t size = block->size & ~MEM_SHARED_FREE;
+        if (size < sizeof(MemSharedBlock) || size > heap->size - offset) break;  // Damaged block list
+        stats->block_count++;
+        stats->metadata_bytes += MEM_SHARED_HEADER;
+        if (block->size & MEM_SHARED_FREE) {
+            stats->free_block_count++;
+            stats->free_bytes += size;
+            if (size > stats->largest_free_block) stats->largest_free_block = size;
+        } else {
+            stats->used_bytes += size;
+        }
+        offset += size;
+    }
+    shared_unlock(heap);
+}
+
+/**
+ * @brief Unmap the heap from this process; it lives on while others have it
+ *        mapped, for a named heap until shm_unlink, and for a mem_open heap in its file.
+ */
+void mem_shared_detach(MemShared* heap) {
+    if (!heap) return;
+    munmap(heap->base, heap->size);
+    close(heap->fd);
+    free(heap);
 }
@@ -2,20 +2,278 @@
 #define MEMORY_MANAGER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 // Initializes the memory manager with a specified size of memory pool
 int mem_init(size_t size);
 
+// Options for mem_init_ex
+typedef struct {
+    unsigned prefault_threads;  // Threads that fault the pool in up front (0 = fault lazily)
+    int lock_pages;             // Non-zero to mlock the pool after prefaulting
+    const char* backing_file;   // New or empty file the pool is mapped from, grown sparse (NULL = anonymous memory)
+} MemInitOptions;
+
+// Page-fault counts of the process around the prefault, filled by mem_init_ex
+typedef struct {
+    long minor_faults_before;
+    long minor_faults_after;
+    long major_faults_before;
+    long major_faults_after;
+    uint64_t prefault_ns;       // Time spent prefaulting and locking
+    int locked;                 // Non-zero if the pool is mlock'ed
+} MemInitReport;
+
+// Initializes the pool like mem_init, optionally prefaulted in parallel and locked, or mapped from a file.
+// A backing file that already holds data is refused, never truncated.
+// report may be NULL. Returns 0 on success, -1 on failure (including mlock failure)
+int mem_init_ex(size_t size, const MemInitOptions* options, MemInitReport* report);
+
 // Allocates a block of memory of the specified size
 void* mem_alloc(size_t size);
 
+// Allocates a zeroed array of n elements of size bytes (NULL on overflow or when n or size is 0)
+void* mem_calloc(size_t n, size_t size);
+
 // Frees the specified block of memory
 void mem_free(void* block);
 
+// Same as mem_free; size is only a debug check against the block (DEBUG builds), release builds ignore it
+void mem_free_sized(void* block, size_t size);
+
+// Returns how many bytes can be used at block without mem_resize (0 if not allocated)
+size_t mem_usable_size(void* block);
+
 // Resizes an allocated block to the new size, returning the new block
 void* mem_resize(void* block, size_t new_size);
 
 // Frees up the memory pool allocated by mem_init
 void mem_deinit();
 
+// Placement policy used by mem_alloc to pick a free block
+typedef enum {
+    MEM_POLICY_FIRST_FIT = 0,   // Lowest-addressed free block that fits (default)
+    MEM_POLICY_NEXT_FIT,        // First fit, resuming after the previous allocation
+    MEM_POLICY_BEST_FIT         // Smallest free block that fits
+} MemPolicy;
+
+// Selects the placement policy; returns 0 on success, -1 on an unknown policy
+int mem_set_policy(MemPolicy policy);
+
+// Fragmentation controls applied to every request
+typedef struct {
+    size_t min_split;           // Remainders smaller than this stay in the block as slack (0 = always split)
+    size_t alignment;           // Power-of-two quantum that sizes and offsets are rounded to (0 or 1 = none)
+    int size_classes;           // Non-zero rounds sizes up to four classes per power of two
+} MemFragPolicy;
+
+// Sets the fragmentation policy (NULL restores the defaults); returns -1 on a bad alignment
+int mem_set_frag_policy(const MemFragPolicy* policy);
+
+// How mem_free merges a freed block with its free neighbours
+typedef enum {
+    MEM_COALESCE_EAGER = 0,     // Merge on every mem_free (default)
+    MEM_COALESCE_DEFERRED       // Park freed blocks on quick lists and merge in batches
+} MemCoalesceMode;
+
+// Selects the coalescing mode; threshold is the number of pending deferred blocks
+// that triggers a batch merge (0 = merge only when an allocation fails).
+// Returns 0 on success, -1 on an unknown mode
+int mem_set_coalescing(MemCoalesceMode mode, size_t threshold);
+
+// Merges all deferred blocks with their free neighbours now
+void mem_coalesce(void);
+
+// Handle to a relocatable block; 0 is never a valid handle
+typedef uint32_t mem_handle_t;
+#define MEM_HANDLE_INVALID 0
+
+// Allocates a relocatable block; its address is only stable while locked
+mem_handle_t mem_handle_alloc(size_t size);
+
+// Pins the block behind a handle and returns its current address (locks nest).
+// mem_free and mem_resize refuse that address; use mem_handle_free
+void* mem_handle_lock(mem_handle_t handle);
+
+// Releases one lock; an unlocked block may be moved by mem_compact
+void mem_handle_unlock(mem_handle_t handle);
+
+// Frees the handle and its block
+void mem_handle_free(mem_handle_t handle);
+
+// Slides unpinned handle blocks together to merge free space; returns bytes moved
+size_t mem_compact(void);
+
+// Mark returned by mem_region_begin; 0 is never a valid mark
+typedef uint32_t mem_region_t;
+#define MEM_REGION_INVALID 0
+#define MEM_REGION_MAX_DEPTH 64
+
+// Opens a (possibly nested) region; mem_alloc then bump-allocates inside it, and
+// falls back to the block list (blocks freed with mem_free) once it is full
+mem_region_t mem_region_begin(void);
+
+// Frees everything allocated since mark at once and closes the regions opened after it
+void mem_region_release(mem_region_t mark);
+
+// Returns whole free pages to the OS; they then count as known-zero. Returns bytes released
+size_t mem_trim(void);
+
+// Bitmap-managed region for small requests, see mem_set_small_blocks
+typedef struct {
+    size_t region_size;         // Bytes set aside for small blocks (0 = disabled)
+    size_t granule;             // Power-of-two allocation unit (0 = 16)
+    size_t threshold;           // Requests of at most this many bytes use the region (at most 64 granules)
+} MemSmallBlocks;
+
+// Routes small mem_alloc requests to a bitmap-managed region carved from the pool on first
+// use (NULL disables it). Returns 0 on success, -1 on a bad config or while small blocks are live
+int mem_set_small_blocks(const MemSmallBlocks* config);
+
+// Size-segregated pages for tiny objects, see mem_set_page_bags
+typedef struct {
+    size_t pages;               // 4 KiB pages set aside, each holding objects of one size (0 = disabled)
+    size_t max_size;            // Requests of at most this many bytes use the pages (at most 512)
+} MemPageBags;
+
+// Serves tiny mem_alloc requests from pages that each hold one object size, so objects need
+// no header (NULL disables them). Returns 0 on success, -1 on a bad config or while objects are live
+int mem_set_page_bags(const MemPageBags* config);
+
+// Access pattern of an allocation, see mem_advise
+typedef enum {
+    MEM_ADVICE_NORMAL = 0,      // No particular pattern (default)
+    MEM_ADVICE_SEQUENTIAL,      // Read front to back: read ahead aggressively, drop pages behind
+    MEM_ADVICE_WILLNEED,        // Needed soon: start reading it in now
+    MEM_ADVICE_COLD             // Not needed for a while: reclaim its pages first under memory pressure
+} MemAdvice;
+
+// Passes a hint for the pages of a live mem_alloc block to the kernel. Nothing is written or dropped
+// at once; cold pages reclaimed later go to the backing file rather than to swap. Returns 0 on success, -1 on failure
+int mem_advise(void* block, MemAdvice advice);
+
+// Makes every function take an internal mutex so several threads may share the pool
+void mem_set_thread_safe(int enabled);
+
+// Duty cycle and wake-up conditions of the maintenance thread
+typedef struct {
+    unsigned interval_ms;       // Sleep between passes
+    unsigned duty_percent;      // Upper bound on the share of time spent in passes (1..100)
+    size_t wake_frees;          // Wake early after this many deferred frees (0 = timer only)
+    uint32_t refill;            // Most blocks kept pre-split per size whose quick list runs dry (0 = none)
+    unsigned trim_idle_ms;      // Return free pages to the OS after this long without allocations (0 = never)
+} MemMaintenanceConfig;
+
+// What the maintenance thread has done, see mem_maintenance_stats
+typedef struct {
+    size_t passes;              // Maintenance passes run
+    size_t coalesces;           // Passes that merged deferred blocks
+    size_t refilled_blocks;     // Blocks pre-split onto quick lists
+    size_t trimmed_bytes;       // Bytes returned to the OS
+} MemMaintenanceStats;
+
+// Starts a background thread that coalesces deferred frees, refills quick lists and
+// trims idle pages (NULL = defaults). The API is serialized by an internal mutex while
+// it runs. Returns 0 on success, -1 on failure
+int mem_maintenance_start(const MemMaintenanceConfig* config);
+
+// Stops the maintenance thread (also done by mem_deinit)
+void mem_maintenance_stop(void);
+
+// Fills stats with the maintenance thread's counters
+void mem_maintenance_stats(MemMaintenanceStats* stats);
+
+// Child pool carved from one block of a parent pool, with its own block list
+typedef struct MemPool MemPool;
+
+// Carves a child pool of size bytes from parent (NULL = the global pool); NULL on failure
+MemPool* mem_pool_create(MemPool* parent, size_t size);
+
+// Allocates, allocates zeroed, frees and resizes blocks inside a pool (NULL = the global pool)
+void* mem_pool_alloc(MemPool* pool, size_t size);
+void* mem_pool_calloc(MemPool* pool, size_t n, size_t size);
+void mem_pool_free(MemPool* pool, void* block);
+void* mem_pool_resize(MemPool* pool, void* block, size_t new_size);
+
+// Destroys pool and its children, returning its extent to the parent with one free.
+// Returns -1 for NULL, the global pool, or a pool a sibling still borrows an extent from
+int mem_pool_destroy(MemPool* pool);
+
+// Lets a child pool that runs out of room take extents of at least min_steal bytes from
+// its siblings (0 = never); emptied extents go back, and a lender cannot be destroyed before.
+// Returns -1 for NULL or the global pool
+int mem_pool_set_stealing(MemPool* pool, size_t min_steal);
+
+// Lock-free pool of fixed-size objects carved from one block of the global pool
+typedef struct MemFixedPool MemFixedPool;
+
+// Carves count objects of object_size bytes (rounded up to and aligned like max_align_t) from the
+// global pool; NULL on failure
+MemFixedPool* mem_fixed_create(size_t object_size, size_t count);
+
+// Pops and pushes an object without taking a lock, from any thread. alloc returns NULL when all are in use
+void* mem_fixed_alloc(MemFixedPool* pool);
+void mem_fixed_free(MemFixedPool* pool, void* object);
+
+// Returns the objects' block to the global pool; no thread may use the pool afterwards
+void mem_fixed_destroy(MemFixedPool* pool);
+
+// Heap in a shared-memory mapping that several processes allocate from; its metadata and
+// process-shared lock live in the mapping and blocks are linked by offset. Every metadata
+// update is journaled in the mapping, so one cut short by a crash is rolled back
+typedef struct MemShared MemShared;
+
+// Creates a heap of size bytes under an shm_open name ("/name"), or as an anonymous memfd
+// shared across fork when name is NULL. NULL on failure
+MemShared* mem_shared_create(const char* name, size_t size);
+
+// Attaches to a heap another process created under name; NULL on failure
+MemShared* mem_shared_attach(const char* name);
+
+// File descriptor behind the heap, for passing an anonymous heap over a Unix socket
+int mem_shared_fd(MemShared* heap);
+
+// Allocates (16-byte aligned) and frees blocks; any attached process may free any block
+void* mem_shared_alloc(MemShared* heap, size_t size);
+void mem_shared_free(MemShared* heap, void* block);
+
+// Converts between this process's addresses and the offsets other processes understand (0 = none)
+size_t mem_shared_offset(MemShared* heap, const void* block);
+void* mem_shared_ptr(MemShared* heap, size_t offset);
+
+// Opens the persistent heap in the file at path, creating it with size bytes if it does not
+// exist; reattaching only maps the file. NULL on failure or while another process has it open
+MemShared* mem_open(const char* path, size_t size);
+
+// Offset of the block the application finds the rest of its data from after mem_open (0 = none)
+int mem_shared_set_root(MemShared* heap, size_t offset);
+size_t mem_shared_root(MemShared* heap);
+
+// Writes the heap back to its file and waits for the disk; returns 0 on success, -1 on failure
+int mem_shared_sync(MemShared* heap);
+
+// Unmaps the heap from this process (and closes a mem_open heap); a named heap stays until shm_unlink
+void mem_shared_detach(MemShared* heap);
+
+// Snapshot of the pool layout, see mem_get_stats
+typedef struct {
+    size_t pool_size;           // Bytes managed by the pool
+    size_t used_bytes;          // Bytes in allocated blocks
+    size_t free_bytes;          // Bytes in free blocks
+    size_t largest_free_block;  // Size of the largest free block
+    size_t block_count;         // Number of blocks in the block list
+    size_t free_block_count;    // Number of free blocks in the block list
+    size_t metadata_bytes;      // Bytes of bookkeeping held outside the pool
+    size_t known_zero_bytes;    // Bytes in pages known to be zero (mem_calloc skips them)
+} MemStats;
+
+// Fills stats with the current layout of the pool (all zero if uninitialized)
+void mem_get_stats(MemStats* stats);
+
+// Fills stats with the layout of a pool (NULL = the global pool)
+void mem_pool_get_stats(MemPool* pool, MemStats* stats);
+
+// Fills stats with the layout of a shared heap
+void mem_shared_get_stats(MemShared* heap, MemStats* stats);
+
 #endif // MEMORY_MANAGER_H
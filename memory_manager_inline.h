@@ -0,0 +1,144 @@
+// memory_manager_inline.h
+#ifndef MEMORY_MANAGER_INLINE_H
+#define MEMORY_MANAGER_INLINE_H
+
+#include "memory_manager.h"
+
+// Inline fast path for small allocations.
+//
+// Each thread keeps a cache of blocks per 16-byte size class. mem_alloc_inline
+// pops the cache without leaving the caller; only an empty class, a large
+// request or a full class goes out of line. Blocks carry a 16-byte header with
+// their class, so mem_alloc_inline and mem_free_inline must always be paired:
+// their pointers must not be passed to mem_free or mem_resize. Blocks are
+// 16-byte aligned.
+//
+// A block freed by a thread other than the one that allocated it is not cached
+// by the freeing thread: it is pushed onto the owner's lock-free remote-free
+// list, and the owner takes the whole list back into its cache on its next
+// trip through mem_tcache_alloc_slow. Producer/consumer pipelines thus recycle
+// blocks on the producer without any lock on the free side.
+//
+// Refills go through the pool, so threads sharing it need mem_set_thread_safe(1)
+// (or the maintenance thread). Link the static library (make mmanager_static)
+// to let LTO inline the slow path too.
+
+#define MEM_TCACHE_GRANULE 16       // Spacing of the size classes
+#define MEM_TCACHE_CLASSES 64       // Classes cover 1..1024 bytes
+#define MEM_TCACHE_MAX_SIZE (MEM_TCACHE_CLASSES * MEM_TCACHE_GRANULE)
+#define MEM_TCACHE_LIMIT 64         // Blocks a thread keeps per class before giving half back
+#define MEM_TCACHE_BATCH 16         // Blocks fetched per refill
+#define MEM_TCACHE_HEADER 16        // Bytes in front of every block; keeps 16-byte alignment
+#define MEM_TCACHE_LARGE 0xFFFFFFFFu // size_class of blocks that bypass the caches
+#define MEM_TCACHE_OWNERS 256       // Threads that can own remote-free lists at once
+
+// Header in front of every block handed out by mem_alloc_inline
+typedef struct MemTCacheHeader {
+    uint32_t size_class;            // Class index, or MEM_TCACHE_LARGE
+    uint32_t owner;                 // Owner slot + 1 of the allocating thread (0 = none)
+    struct MemTCacheHeader* next;   // Next cached block while on a thread cache
+} MemTCacheHeader;
+
+// One thread's cached blocks
+typedef struct {
+    MemTCacheHeader* head[MEM_TCACHE_CLASSES];
+    uint32_t count[MEM_TCACHE_CLASSES];
+    uint64_t generation;            // Pool generation the cached blocks belong to
+    uint32_t owner;                 // This thread's owner slot + 1, 0 until it has one
+} MemThreadCache;
+
+extern __thread MemThreadCache mem_tcache;
+extern uint64_t mem_tcache_generation;
+
+// Out-of-line halves of the fast path
+void* mem_tcache_alloc_slow(size_t size);
+void mem_tcache_free_slow(MemTCacheHeader* obj);
+
+// Returns the calling thread's cached blocks, and the blocks other threads freed to it,
+// to the pool (done automatically at thread exit)
+void mem_tcache_flush(void);
+
+// Allocates size bytes, from the thread cache when possible
+static inline void* mem_alloc_inline(size_t size) {
+    if (size - 1 < MEM_TCACHE_MAX_SIZE && mem_tcache.generation == mem_tcache_generation) {
+        size_t size_class = (size - 1) / MEM_TCACHE_GRANULE;
+        MemTCacheHeader* obj = mem_tcache.head[size_class];
+        if (obj) {
+            mem_tcache.head[size_class] = obj->next;
+            mem_tcache.count[size_class]--;
+            return (char*)obj + MEM_TCACHE_HEADER;
+        }
+    }
+    return mem_tcache_alloc_slow(size);
+}
+
+// Frees a block from mem_alloc_inline, into the thread cache when this thread owns it
+// and there is room; a block owned by another thread goes onto that thread's remote list
+static inline void mem_free_inline(void* ptr) {
+    if (!ptr) return;
+    MemTCacheHeader* obj = (MemTCacheHeader*)((char*)ptr - MEM_TCACHE_HEADER);
+    uint32_t size_class = obj->size_class;
+    if (size_class < MEM_TCACHE_CLASSES && obj->owner == mem_tcache.owner &&
+        mem_tcache.count[size_class] < MEM_TCACHE_LIMIT && mem_tcache.generation == mem_tcache_generation) {
+        obj->next = mem_tcache.head[size_class];
+        mem_tcache.head[size_class] = obj;
+        mem_tcache.count[size_class]++;
+        return;
+    }
+    mem_tcache_free_slow(obj);
+}
+
+// Bump-pointer thread-local allocation buffers (TLABs) with epoch reclamation.
+//
+// A thread brackets each unit of work (a request, a parse) with mem_tlab_begin
+// and mem_tlab_end, which pin the global epoch. In between, mem_tlab_alloc
+// bumps a pointer through a buffer of MEM_TLAB_SIZE bytes taken from the pool.
+// Objects are never freed one by one: each buffer is stamped with the epoch it
+// was last used in, and mem_epoch_advance frees the full buffers whose epoch
+// is older than the epoch every pinned thread entered with. A thread's current
+// buffer is rewound by its next mem_tlab_begin once it is safe.
+//
+// An object may be used by any thread that was pinned before the object's
+// section ended, until that thread unpins. Like the caches above, several
+// threads need mem_set_thread_safe(1).
+
+#define MEM_TLAB_SIZE (64 * 1024)   // Bytes per buffer, header included (alignment padding not)
+#define MEM_TLAB_ALIGN 16           // Alignment of every TLAB object
+#define MEM_TLAB_THREADS 256        // Threads that can be pinned at once
+
+// One thread's current buffer
+typedef struct {
+    char* cursor;                   // Next free byte
+    char* limit;                    // End of the buffer
+    void* buffer;                   // Current buffer, NULL before the first allocation
+    uint64_t generation;            // Pool generation the buffer belongs to
+    uint64_t pinned;                // Epoch this thread entered with, 0 outside a section
+    uint32_t slot;                  // This thread's pin slot + 1, 0 until it has one
+} MemTlab;
+
+extern __thread MemTlab mem_tlab;
+
+// Out-of-line half of mem_tlab_alloc: a new buffer, or a request too large to share one
+void* mem_tlab_alloc_slow(size_t size);
+
+// Pins the current epoch for the calling thread; returns -1 if all MEM_TLAB_THREADS slots are held
+int mem_tlab_begin(void);
+
+// Unpins the calling thread; its objects from this section may be reclaimed after the next advance
+void mem_tlab_end(void);
+
+// Advances the global epoch and frees the buffers no pinned thread can still use; returns the new epoch
+uint64_t mem_epoch_advance(void);
+
+// Allocates size bytes (16-byte aligned) inside a pinned section; NULL outside one
+static inline void* mem_tlab_alloc(size_t size) {
+    size_t rounded = (size + MEM_TLAB_ALIGN - 1) & ~(size_t)(MEM_TLAB_ALIGN - 1);
+    if (rounded - 1 < (size_t)(mem_tlab.limit - mem_tlab.cursor) && mem_tlab.generation == mem_tcache_generation) {
+        void* ptr = mem_tlab.cursor;
+        mem_tlab.cursor += rounded;
+        return ptr;
+    }
+    return mem_tlab_alloc_slow(size);
+}
+
+#endif // MEMORY_MANAGER_INLINE_H
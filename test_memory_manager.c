@@ -1,4 +1,5 @@
 #include "memory_manager.h"
+#include "memory_manager_inline.h"
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
@@ -7,6 +8,12 @@
 #include <dlfcn.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <pthread.h>
 #include "common_defs.h"
 
 #include "gitdata.h"
@@ -340,6 +347,1169 @@ void test_edge_case_allocations()
     printf_green("[PASS].\n");
 }
 
+void test_placement_policies()
+{
+    printf_yellow("  Testing placement policies ---> ");
+    mem_init(1024);
+
+    // Holes of 300 and 100 bytes, separated by allocated blocks
+    void *block1 = mem_alloc(300);
+    void *block2 = mem_alloc(100);
+    void *block3 = mem_alloc(100);
+    void *block4 = mem_alloc(100);
+    mem_free(block1);
+    mem_free(block3);
+
+    my_assert(mem_set_policy(MEM_POLICY_BEST_FIT) == 0);
+    void *best = mem_alloc(100); // Best fit takes the exact 100 byte hole
+    my_assert(best == block3);
+    mem_free(best);
+
+    my_assert(mem_set_policy(MEM_POLICY_FIRST_FIT) == 0);
+    void *first = mem_alloc(100); // First fit takes the lowest hole
+    my_assert(first == block1);
+    mem_free(first);
+
+    my_assert(mem_set_policy(MEM_POLICY_NEXT_FIT) == 0);
+    void *next1 = mem_alloc(50);  // Cursor was reset, so this lands at the start
+    my_assert(next1 == block1);
+    void *next2 = mem_alloc(50);  // Resumes right after next1
+    my_assert((char *)next2 == (char *)next1 + 50);
+
+    my_assert(mem_set_policy((MemPolicy)42) == -1);
+    mem_set_policy(MEM_POLICY_FIRST_FIT);
+
+    mem_free(next1);
+    mem_free(next2);
+    mem_free(block2);
+    mem_free(block4);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_stats()
+{
+    printf_yellow("  Testing mem_get_stats ---> ");
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.pool_size == 0); // Not initialized
+
+    mem_init(1024);
+    void *block1 = mem_alloc(200);
+    void *block2 = mem_alloc(300);
+    mem_free(block1);
+    mem_get_stats(&stats);
+    my_assert(stats.pool_size == 1024);
+    my_assert(stats.used_bytes == 300);
+    my_assert(stats.free_bytes == 724);
+    my_assert(stats.largest_free_block == 524);
+    my_assert(stats.block_count == 3);
+    my_assert(stats.free_block_count == 2);
+    my_assert(stats.metadata_bytes > 0);
+
+    mem_free(block2);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+    my_assert(stats.largest_free_block == 1024);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_deferred_coalescing()
+{
+    printf_yellow("  Testing deferred coalescing ---> ");
+    MemStats stats;
+    mem_init(1024);
+    my_assert(mem_set_coalescing(MEM_COALESCE_DEFERRED, 0) == 0);
+
+    void *block1 = mem_alloc(100);
+    void *block2 = mem_alloc(100);
+    mem_free(block1);
+    mem_free(block1); // Double free of a deferred block is ignored
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 3); // Nothing merged or split
+
+    void *block3 = mem_alloc(100); // Same size comes straight off the quick list
+    my_assert(block3 == block1);
+
+    mem_free(block3);
+    mem_free(block2);
+    void *block4 = mem_alloc(1024); // Only fits once the deferred blocks are merged
+    my_assert(block4 == block1);
+    mem_free(block4);
+
+    // A threshold of 2 merges as soon as two blocks are pending
+    mem_set_coalescing(MEM_COALESCE_DEFERRED, 2);
+    block1 = mem_alloc(100);
+    block2 = mem_alloc(100);
+    mem_free(block1);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 3);
+    mem_free(block2);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+
+    my_assert(mem_set_coalescing(MEM_COALESCE_EAGER, 0) == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_handle_compaction()
+{
+    printf_yellow("  Testing handles and mem_compact ---> ");
+    mem_init(800);
+
+    // Same layout as test_non_contiguous_allocation_failure, but relocatable
+    mem_handle_t h1 = mem_handle_alloc(250);
+    mem_handle_t h2 = mem_handle_alloc(250);
+    mem_handle_t h3 = mem_handle_alloc(250);
+    my_assert(h1 != MEM_HANDLE_INVALID && h2 != MEM_HANDLE_INVALID && h3 != MEM_HANDLE_INVALID);
+
+    char *data = mem_handle_lock(h2);
+    memset(data, 'B', 250);
+    my_assert(mem_resize(data, 400) == NULL); // Handle blocks only go through the handle API
+    mem_free(data);
+    my_assert(mem_usable_size(data) >= 250);
+    mem_handle_unlock(h2);
+
+    mem_handle_free(h1);
+    mem_handle_free(h3);
+    my_assert(mem_handle_lock(h1) == NULL); // Freed handles no longer resolve
+    my_assert(mem_alloc(500) == NULL);
+
+    // A pinned block stays where it is
+    char *pinned = mem_handle_lock(h2);
+    my_assert(mem_compact() == 0);
+    my_assert(mem_handle_lock(h2) == pinned);
+    mem_handle_unlock(h2);
+    mem_handle_unlock(h2);
+
+    my_assert(mem_compact() == 250);
+    data = mem_handle_lock(h2);
+    my_assert(data != pinned);
+    for (int i = 0; i < 250; i++)
+        my_assert(data[i] == 'B');
+    mem_handle_unlock(h2);
+
+    void *block = mem_alloc(500); // Free space is contiguous again
+    my_assert(block != NULL);
+
+    mem_free(block);
+    mem_handle_free(h2);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_regions()
+{
+    printf_yellow("  Testing nested regions ---> ");
+    mem_init(1024);
+
+    void *block = mem_alloc(100); // Lives outside the region
+    mem_region_t outer = mem_region_begin();
+    my_assert(outer != MEM_REGION_INVALID);
+
+    char *a = mem_alloc(100);
+    my_assert(a == (char *)block + 100); // Region extent is the free space after block
+    char *b = mem_alloc(50);
+    my_assert(b == a + 100);             // Bump pointer
+    mem_free(a);                         // Ignored inside a region
+    my_assert(mem_usable_size(a) == 100 && mem_usable_size(b) == 50);
+
+    mem_region_t inner = mem_region_begin();
+    my_assert(inner != MEM_REGION_INVALID && inner != outer);
+    char *c = mem_alloc(200);
+    my_assert(c == b + 50);
+    c = mem_resize(c, 300);              // Newest allocation grows in place
+    my_assert(c == b + 50);
+    memset(a, 'A', 100);
+    memset(b, 'B', 50);
+    char *moved = mem_resize(a, 150);    // Older allocation moves; only its own 100 bytes are copied
+    my_assert(moved == c + 300 && mem_usable_size(a) == 100);
+    for (int i = 0; i < 150; i++)
+        my_assert(moved[i] == (i < 100 ? 'A' : 0));
+    my_assert(mem_alloc(1024) == NULL);  // Larger than what is left of the extent
+
+    mem_region_release(inner);
+    my_assert(mem_alloc(10) == b + 50);  // Everything after the inner mark is gone
+
+    mem_region_release(outer);
+    void *rest = mem_alloc(924);         // The extent went back to the block list
+    my_assert(rest == (char *)block + 100);
+
+    mem_free(rest);
+    mem_free(block);
+    mem_deinit();
+
+    // A full region falls back to the block list, and internal allocations never use it
+    mem_init(4096);
+    void *x = mem_alloc(1000);
+    void *y = mem_alloc(1000);
+    mem_free(x);                         // Free: [0, 1000) and [2000, 4096)
+    outer = mem_region_begin();          // Takes the larger one
+    char *bump = mem_alloc(2000);
+    my_assert(bump == (char *)y + 1000);
+    void *spill = mem_alloc(500);
+    my_assert(spill == x);               // From the block list
+    mem_free(spill);
+    my_assert(mem_usable_size(spill) == 0);
+    MemFixedPool *fixed = mem_fixed_create(8, 16);
+    my_assert(fixed != NULL);
+    mem_region_release(outer);
+    unsigned long *object = mem_fixed_alloc(fixed);
+    my_assert(object == x);              // Still owns its block after the release
+    *object = 42;
+    my_assert(mem_alloc(2096) != NULL);  // The region extent is whole again
+    mem_fixed_free(fixed, object);
+    mem_fixed_destroy(fixed);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_calloc()
+{
+    printf_yellow("  Testing mem_calloc and known-zero pages ---> ");
+    MemStats stats;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    mem_init(4 * page);
+    mem_get_stats(&stats);
+    my_assert(stats.known_zero_bytes == 4 * page); // Fresh mapping is all zero
+
+    my_assert(mem_calloc((size_t)-1, 2) == NULL); // n * size overflows
+    my_assert(mem_calloc(0, 16) == NULL && mem_calloc(16, 0) == NULL); // Nothing to allocate
+
+    unsigned char *block1 = mem_calloc(10, 100);
+    my_assert(block1 != NULL);
+    for (int i = 0; i < 1000; i++)
+        my_assert(block1[i] == 0);
+    memset(block1, 0xFF, 1000);
+    mem_get_stats(&stats);
+    my_assert(stats.known_zero_bytes == 3 * page);
+
+    mem_free(block1);
+    unsigned char *block2 = mem_calloc(10, 100); // Dirty page is cleared again
+    my_assert(block2 == block1);
+    for (int i = 0; i < 1000; i++)
+        my_assert(block2[i] == 0);
+    memset(block2, 0xFF, 1000);
+    mem_free(block2);
+
+    my_assert(mem_trim() == 4 * page); // Whole pool is free again
+    mem_get_stats(&stats);
+    my_assert(stats.known_zero_bytes == 4 * page);
+    unsigned char *block3 = mem_calloc(1, 1000);
+    for (int i = 0; i < 1000; i++)
+        my_assert(block3[i] == 0);
+
+    mem_free(block3);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_usable_size_and_sized_free()
+{
+    printf_yellow("  Testing mem_usable_size and mem_free_sized ---> ");
+    mem_init(1024);
+
+    void *block1 = mem_alloc(100);
+    void *block2 = mem_alloc(200);
+    my_assert(mem_usable_size(block1) == 100);
+    my_assert(mem_usable_size(block2) == 200);
+    my_assert(mem_usable_size((char *)block1 + 1) == 0); // Not the start of a block
+    my_assert(mem_usable_size(NULL) == 0);
+
+    mem_free_sized(block1, 100);
+    my_assert(mem_usable_size(block1) == 0);
+    mem_free_sized(block2, 200);
+
+    void *block3 = mem_alloc(1024); // Both frees merged back into one block
+    my_assert(block3 == block1);
+    mem_free(block3);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_fragmentation_policy()
+{
+    printf_yellow("  Testing split threshold, alignment and size classes ---> ");
+    mem_init(1024);
+
+    MemFragPolicy policy = { 32, 1, 0 };
+    my_assert(mem_set_frag_policy(&policy) == 0);
+    void *block1 = mem_alloc(1000); // 24-byte remainder stays in the block
+    my_assert(mem_usable_size(block1) == 1024);
+    mem_free(block1);
+
+    policy = (MemFragPolicy){ 0, 16, 0 };
+    my_assert(mem_set_frag_policy(&policy) == 0);
+    void *block2 = mem_alloc(10);
+    void *block3 = mem_alloc(10);
+    my_assert(mem_usable_size(block2) == 16);
+    my_assert((char *)block3 == (char *)block2 + 16);
+    mem_free(block2);
+    mem_free(block3);
+
+    policy = (MemFragPolicy){ 0, 1, 1 };
+    my_assert(mem_set_frag_policy(&policy) == 0);
+    void *block4 = mem_alloc(100); // Class spacing between 64 and 128 is 16
+    my_assert(mem_usable_size(block4) == 112);
+    void *block5 = mem_alloc(5);
+    my_assert(mem_usable_size(block5) == 16);
+    mem_free(block4);
+    mem_free(block5);
+
+    policy = (MemFragPolicy){ 0, 24, 0 };
+    my_assert(mem_set_frag_policy(&policy) == -1); // Not a power of two
+    my_assert(mem_set_frag_policy(NULL) == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_maintenance_thread()
+{
+    printf_yellow("  Testing background coalescing and trimming ---> ");
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    mem_init(page * 4);
+    mem_set_coalescing(MEM_COALESCE_DEFERRED, 0); // Leave all merging to the thread
+
+    MemMaintenanceConfig config = { 1, 100, 4, 0, 5 };
+    my_assert(mem_maintenance_start(&config) == 0);
+    my_assert(mem_maintenance_start(&config) == -1); // Already running
+
+    void *blocks[8];
+    for (int i = 0; i < 8; i++) {
+        blocks[i] = mem_alloc(64);
+        memset(blocks[i], 0xAB, 64);
+    }
+    for (int i = 0; i < 8; i++) mem_free(blocks[i]);
+
+    // The thread merges the deferred blocks, then trims once allocations stop
+    MemStats stats;
+    for (int tries = 0; tries < 2000; tries++) {
+        mem_get_stats(&stats);
+        if (stats.block_count == 1 && stats.known_zero_bytes == page * 4) break;
+        usleep(1000);
+    }
+    my_assert(stats.block_count == 1);
+    my_assert(stats.known_zero_bytes == page * 4);
+
+    MemMaintenanceStats maint;
+    mem_maintenance_stats(&maint);
+    my_assert(maint.coalesces >= 1);
+    my_assert(maint.trimmed_bytes >= page);
+    mem_maintenance_stop();
+
+    // A hot size keeps its refilled blocks parked instead of merging and re-splitting them every pass
+    MemMaintenanceConfig refill = { 1, 100, 0, 4, 0 };
+    my_assert(mem_maintenance_start(&refill) == 0);
+    for (int i = 0; i < 200; i++) {
+        void *hot = mem_alloc(48);
+        my_assert(hot != NULL);
+        mem_free(hot);
+        usleep(250);
+    }
+    mem_maintenance_stats(&maint);
+    my_assert(maint.passes >= 10);
+    my_assert(maint.refilled_blocks <= 4);
+
+    mem_maintenance_stop();
+    mem_set_coalescing(MEM_COALESCE_EAGER, 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_prefault()
+{
+    printf_yellow("  Testing parallel prefault and mlock ---> ");
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = page * 64;
+
+    MemInitOptions options = { 4, 1 };
+    MemInitReport report;
+    my_assert(mem_init_ex(size, &options, &report) == 0);
+    my_assert(report.locked == 1);
+    my_assert(report.minor_faults_after > report.minor_faults_before);
+
+    // Every page is already present, so touching the whole pool does not fault
+    char *block = mem_alloc(size);
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    memset(block, 0x5A, size);
+    getrusage(RUSAGE_SELF, &after);
+    my_assert(after.ru_minflt - before.ru_minflt < 4);
+    mem_free(block);
+    mem_deinit();
+
+    // Prefaulting writes zeros, so the pool is still known to be zero
+    options.lock_pages = 0;
+    my_assert(mem_init_ex(size, &options, NULL) == 0);
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.known_zero_bytes == size);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+// Address space of the process in KiB, from /proc/self/status
+static size_t vm_size_kb()
+{
+    char line[256];
+    size_t kb = 0;
+    FILE *status = fopen("/proc/self/status", "r");
+    while (status && fgets(line, sizeof(line), status))
+        if (sscanf(line, "VmSize: %zu kB", &kb) == 1) break;
+    if (status) fclose(status);
+    return kb;
+}
+
+void test_lazy_init()
+{
+    printf_yellow("  Testing lazily committed huge pool ---> ");
+    size_t size = (size_t)8 << 30; // Only the touched pages are ever committed
+    size_t vm_before = vm_size_kb();
+    my_assert(mem_init(size) == 0);
+    my_assert(vm_size_kb() - vm_before < (size >> 10) + 64 * 1024); // Metadata is not reserved per pool byte
+
+    char *small = mem_alloc(64);
+    char *huge = mem_alloc(size / 2);
+    my_assert(small != NULL && huge != NULL);
+    small[0] = 1;
+    huge[0] = 1;
+    huge[size / 2 - 1] = 1;
+
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.pool_size == size);
+    my_assert(stats.block_count == 3);
+
+    for (int i = 0; i < 1000; i++) mem_free(mem_alloc(32)); // Nodes are recycled
+    static void *many[20000];
+    for (int i = 0; i < 20000; i++) { // Spans several node chunks
+        many[i] = mem_alloc(16);
+        my_assert(many[i] != NULL);
+    }
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 20003);
+    for (int i = 0; i < 20000; i++) mem_free(many[i]);
+    mem_free(huge);
+    mem_free(small);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+static void *inline_worker(void *arg)
+{
+    (void)arg;
+    void *live[32] = { NULL };
+    for (int i = 0; i < 20000; i++) {
+        int slot = i % 32;
+        mem_free_inline(live[slot]);
+        live[slot] = mem_alloc_inline(1 + (i * 7) % 600);
+        assert(live[slot] != NULL);
+        *(char *)live[slot] = (char)i;
+    }
+    for (int slot = 0; slot < 32; slot++) mem_free_inline(live[slot]);
+    return NULL; // Thread exit flushes this thread's cache
+}
+
+void test_inline_fast_path()
+{
+    printf_yellow("  Testing inline thread-cache fast path ---> ");
+    mem_init(1 << 20);
+    char *odd = mem_alloc(3); // Leaves the rest of the pool misaligned
+    my_assert(odd != NULL);
+
+    void *block1 = mem_alloc_inline(24);
+    my_assert(block1 != NULL && ((uintptr_t)block1 % 16) == 0);
+    mem_free_inline(block1);
+    my_assert(mem_alloc_inline(20) == block1); // Same class, popped from the cache
+    mem_free_inline(block1);
+    void *batch[MEM_TCACHE_BATCH + 1];
+    for (int i = 0; i <= MEM_TCACHE_BATCH; i++) {
+        batch[i] = mem_alloc_inline(40);
+        my_assert(batch[i] != NULL && ((uintptr_t)batch[i] % 16) == 0);
+    }
+    for (int i = 0; i <= MEM_TCACHE_BATCH; i++) mem_free_inline(batch[i]);
+
+    void *large = mem_alloc_inline(MEM_TCACHE_MAX_SIZE + 3); // Bypasses the caches
+    my_assert(large != NULL && ((uintptr_t)large % 16) == 0);
+    mem_free_inline(large);
+    mem_free(odd);
+
+    mem_tcache_flush();
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+
+    // Caches from a previous pool are dropped, not reused
+    mem_free_inline(mem_alloc_inline(24));
+    mem_deinit();
+    mem_init(1 << 20);
+    mem_set_thread_safe(1);
+    pthread_t threads[3];
+    for (int t = 0; t < 3; t++) pthread_create(&threads[t], NULL, inline_worker, NULL);
+    for (int t = 0; t < 3; t++) pthread_join(threads[t], NULL);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+
+    mem_set_thread_safe(0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_sub_pools()
+{
+    printf_yellow("  Testing child pools carved from a parent ---> ");
+    mem_init(64 * 1024);
+
+    char *before = mem_alloc(256);
+    MemPool *child = mem_pool_create(NULL, 16 * 1024);
+    my_assert(child != NULL);
+    char *after = mem_alloc(256);
+
+    // The child's allocations stay inside its extent and off the global list
+    MemStats stats;
+    void *blocks[32];
+    for (int i = 0; i < 32; i++) {
+        blocks[i] = mem_pool_alloc(child, 100 + i);
+        my_assert(blocks[i] != NULL);
+        my_assert((char *)blocks[i] > before && (char *)blocks[i] < after);
+        memset(blocks[i], i, 100 + i);
+    }
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 4);
+    mem_free(blocks[0]); // Not a global block: ignored
+    mem_pool_get_stats(child, &stats);
+    my_assert(stats.block_count == 33);
+    my_assert(stats.pool_size == 16 * 1024);
+
+    mem_pool_free(child, blocks[1]);
+    blocks[2] = mem_pool_resize(child, blocks[2], 4000);
+    my_assert(blocks[2] != NULL && ((char *)blocks[2])[101] == 2);
+    my_assert(mem_pool_alloc(child, 16 * 1024) == NULL); // Never spills into the parent
+
+    // A grandchild goes away with its parent
+    MemPool *grandchild = mem_pool_create(child, 2048);
+    my_assert(grandchild != NULL);
+    my_assert(mem_pool_calloc(grandchild, 16, 16) != NULL);
+
+    // One free returns the whole extent to the global pool
+    my_assert(mem_pool_destroy(child) == 0);
+    mem_free(before);
+    mem_free(after);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+    my_assert(mem_alloc(64 * 1024) != NULL);
+
+    // Children left alive are torn down by mem_deinit
+    mem_deinit();
+    mem_init(8192);
+    my_assert(mem_pool_create(NULL, 4096) != NULL);
+    my_assert(mem_pool_create(NULL, 8192) == NULL);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+// Offsets (+1, 0 on failure) picked by a placement policy for a fixed alloc/free
+// sequence in the first 256 KiB of a pool whose tail is taken by one block
+static void block_table_trace(MemPolicy policy, size_t pool_size, size_t *trace, int n)
+{
+    void *live[64] = { NULL };
+    mem_init(pool_size);
+    char *base = mem_alloc(256 * 1024);
+    my_assert(mem_alloc(pool_size - 256 * 1024) != NULL);
+    mem_free(base);
+    mem_set_policy(policy);
+
+    unsigned seed = 12345;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        int slot = (seed >> 16) % 64;
+        if (live[slot]) {
+            mem_free(live[slot]);
+            live[slot] = NULL;
+            trace[i] = SIZE_MAX;
+        } else {
+            live[slot] = mem_alloc(16 + (seed >> 8) % 8000);
+            trace[i] = live[slot] ? (size_t)((char *)live[slot] - base) + 1 : 0;
+        }
+    }
+    mem_set_policy(MEM_POLICY_FIRST_FIT);
+    mem_deinit();
+}
+
+void test_block_table()
+{
+    printf_yellow("  Testing block table scan against the list walk ---> ");
+    enum { OPS = 4000 };
+    static size_t scanned[OPS], walked[OPS];
+    MemPolicy policies[] = { MEM_POLICY_FIRST_FIT, MEM_POLICY_NEXT_FIT, MEM_POLICY_BEST_FIT };
+
+    // Pools under 4 GiB search the block table, larger ones walk the list
+    for (int p = 0; p < 3; p++) {
+        block_table_trace(policies[p], 260 * 1024, scanned, OPS);
+        block_table_trace(policies[p], (size_t)5 << 30, walked, OPS);
+        my_assert(memcmp(scanned, walked, sizeof(scanned)) == 0);
+    }
+
+    mem_init(64 * 1024);
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.metadata_bytes >= 64 * (2 * sizeof(uint32_t) + sizeof(void *)));
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_small_blocks()
+{
+    printf_yellow("  Testing small-block region ---> ");
+    MemSmallBlocks config = { 4096, 16, 128 };
+    MemSmallBlocks bad_granule = { 4096, 24, 128 };
+    MemSmallBlocks bad_threshold = { 4096, 16, 2000 };
+    my_assert(mem_set_small_blocks(&bad_granule) == -1);
+    my_assert(mem_set_small_blocks(&bad_threshold) == -1);
+    my_assert(mem_set_small_blocks(&config) == 0);
+    mem_init(64 * 1024);
+
+    // Small requests round up to granules and add no blocks to the list
+    char* a = mem_alloc(24);
+    char* b = mem_alloc(100);
+    void* big = mem_alloc(200);
+    my_assert(a && b && big);
+    my_assert(mem_usable_size(a) == 32 && mem_usable_size(b) == 112);
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 3);
+    my_assert(mem_set_small_blocks(NULL) == -1);
+
+    mem_free(a);
+    mem_free(a);  // Double free is ignored
+    my_assert(mem_usable_size(a) == 0);
+    memset(b, 0xAB, 100);
+    mem_free(b);
+    unsigned char* z = mem_calloc(10, 10);
+    my_assert(z && mem_usable_size(z) == 112);
+    for (int i = 0; i < 100; i++) my_assert(z[i] == 0);
+
+    // Growing past the run moves the block and keeps its bytes
+    memset(z, 0x5A, 100);
+    unsigned char* moved = mem_resize(z, 120);
+    my_assert(moved && moved != z && mem_usable_size(moved) == 128);
+    for (int i = 0; i < 100; i++) my_assert(moved[i] == 0x5A);
+
+    // Once the region is full small requests fall back to the block list
+    void* fill[256];
+    size_t n = 0;
+    for (;; n++) {
+        fill[n] = mem_alloc(128);
+        mem_get_stats(&stats);
+        if (!fill[n] || stats.block_count != 3 || n == 255) break;
+    }
+    my_assert(fill[n] && stats.block_count == 4 && n >= 30);
+    mem_free(fill[n]);
+    for (size_t k = 0; k < n; k++) mem_free(fill[k]);
+    mem_free(moved);
+    mem_free(big);
+
+    my_assert(mem_set_small_blocks(NULL) == 0);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1 && stats.free_bytes == 64 * 1024);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_page_bags()
+{
+    printf_yellow("  Testing size-segregated page bags ---> ");
+    MemPageBags config = { 3, 64 };
+    MemPageBags too_large = { 3, 1024 };
+    my_assert(mem_set_page_bags(&too_large) == -1);
+    my_assert(mem_set_page_bags(&config) == 0);
+    mem_init(64 * 1024);
+
+    // Objects of one size share a page and sit back to back, with no header
+    char* a = mem_alloc(24);
+    char* b = mem_alloc(20);
+    char* c = mem_alloc(64);
+    my_assert(a && b && c && b == a + 24);
+    my_assert(mem_usable_size(a) == 24 && mem_usable_size(b) == 24 && mem_usable_size(c) == 64);
+    my_assert((uintptr_t)a / 4096 != (uintptr_t)c / 4096);
+    my_assert(mem_usable_size(a + 8) == 0);
+    mem_free(a + 8);  // Interior pointers are ignored
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 2);
+
+    // One page of 64-byte objects, two of 24-byte objects (170 per page), then the block list
+    static char* nodes[400];
+    size_t n = 0;
+    nodes[n++] = a;
+    nodes[n++] = b;
+    for (;; n++) {
+        nodes[n] = mem_alloc(24);
+        mem_get_stats(&stats);
+        if (!nodes[n] || stats.block_count != 2 || n == 399) break;
+    }
+    my_assert(n == 340 && nodes[n] && stats.block_count == 3);
+    mem_free(nodes[n]);
+
+    mem_free(b);
+    mem_free(b);  // Double free is ignored
+    my_assert(mem_usable_size(b) == 0);
+    memset(a, 0xFF, 24);
+    mem_free(a);
+    unsigned char* z = mem_calloc(3, 8);
+    my_assert(z == (unsigned char*)a);
+    for (int i = 0; i < 24; i++) my_assert(z[i] == 0);
+    my_assert(mem_set_page_bags(NULL) == -1);
+
+    // Growing an object moves it out of its page
+    memset(c, 0x5A, 64);
+    unsigned char* moved = mem_resize(c, 100);
+    my_assert(moved && moved != (unsigned char*)c);
+    for (int i = 0; i < 64; i++) my_assert(moved[i] == 0x5A);
+    mem_free(moved);
+
+    for (size_t k = 0; k < n; k++) mem_free(nodes[k]);
+    my_assert(mem_set_page_bags(NULL) == 0);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1 && stats.free_bytes == 64 * 1024);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+static void *fixed_worker(void *arg)
+{
+    MemFixedPool *pool = arg;
+    uintptr_t self = (uintptr_t)pthread_self();
+    for (int i = 0; i < 100000; i++) {
+        uintptr_t *object = mem_fixed_alloc(pool);
+        if (!object) continue;
+        object[1] = self; // Nobody else may hold the object until it is pushed back
+        for (volatile int spin = 0; spin < 16; spin++) {}
+        if (object[1] != self) return (void *)1;
+        mem_fixed_free(pool, object);
+    }
+    return NULL;
+}
+
+void test_fixed_pool()
+{
+    printf_yellow("  Testing lock-free fixed-size pool ---> ");
+    mem_init(64 * 1024);
+    char *odd = mem_alloc(3); // Leaves the rest of the pool misaligned
+    my_assert(odd != NULL);
+    my_assert(mem_fixed_create(0, 8) == NULL);
+    my_assert(mem_fixed_create(20, 1000000) == NULL); // Larger than the global pool
+
+    MemFixedPool *pool = mem_fixed_create(20, 8);
+    my_assert(pool != NULL);
+    size_t align = _Alignof(max_align_t), stride = (20 + align - 1) & ~(align - 1);
+    char *objects[8];
+    for (int i = 0; i < 8; i++) {
+        objects[i] = mem_fixed_alloc(pool);
+        my_assert(objects[i] != NULL && ((uintptr_t)objects[i] % align) == 0);
+        memset(objects[i], i, 20);
+    }
+    my_assert(objects[1] == objects[0] + stride);
+    my_assert(mem_fixed_alloc(pool) == NULL);
+
+    // Last in, first out; foreign and interior pointers are ignored
+    mem_fixed_free(pool, objects[3]);
+    mem_fixed_free(pool, objects[3] + 4);
+    mem_fixed_free(pool, objects[0] - stride);
+    my_assert(mem_fixed_alloc(pool) == objects[3]);
+    my_assert(mem_fixed_alloc(pool) == NULL);
+    for (int i = 0; i < 8; i++) mem_fixed_free(pool, objects[i]);
+
+    // Threads hammering the stack never share an object and lose none
+    pthread_t threads[4];
+    void *failed = NULL;
+    for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, fixed_worker, pool);
+    for (int t = 0; t < 4; t++) {
+        void *result;
+        pthread_join(threads[t], &result);
+        failed = result ? result : failed;
+    }
+    my_assert(failed == NULL);
+    int count = 0;
+    while (mem_fixed_alloc(pool)) count++;
+    my_assert(count == 8);
+
+    mem_fixed_destroy(pool);
+    mem_free(odd);
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+static void *remote_free_worker(void *arg)
+{
+    void **blocks = arg;
+    for (int i = 0; i < 100; i++) mem_free_inline(blocks[i]);
+    // Another thread's blocks never land in this thread's cache
+    return mem_tcache.head[2] || mem_tcache.count[2] ? (void *)1 : NULL;
+}
+
+void test_remote_free()
+{
+    printf_yellow("  Testing remote frees back to the allocating thread ---> ");
+    mem_init(1 << 20);
+    mem_set_thread_safe(1);
+
+    void *blocks[100];
+    for (int i = 0; i < 100; i++) {
+        blocks[i] = mem_alloc_inline(48);
+        my_assert(blocks[i] != NULL);
+    }
+    pthread_t consumer;
+    void *result;
+    pthread_create(&consumer, NULL, remote_free_worker, blocks);
+    pthread_join(consumer, &result);
+    my_assert(result == NULL);
+
+    // The next refill drains the remote list instead of carving new blocks
+    int recycled = 0;
+    void *again[64];
+    for (int i = 0; i < 64; i++) {
+        again[i] = mem_alloc_inline(48);
+        for (int k = 0; k < 100; k++) recycled += again[i] == blocks[k];
+    }
+    my_assert(recycled >= 52);
+
+    for (int i = 0; i < 64; i++) mem_free_inline(again[i]);
+    mem_tcache_flush();
+    MemStats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+
+    mem_set_thread_safe(0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_pool_stealing()
+{
+    printf_yellow("  Testing child pools stealing free extents from siblings ---> ");
+    mem_init(64 * 1024);
+    MemPool *starved = mem_pool_create(NULL, 16 * 1024);
+    MemPool *rich = mem_pool_create(NULL, 16 * 1024);
+    my_assert(starved && rich);
+    my_assert(mem_pool_set_stealing(NULL, 4096) == -1);
+    char *rich_start = mem_pool_alloc(rich, 100);
+    my_assert(rich_start != NULL);
+
+    char *own = mem_pool_alloc(starved, 16 * 1024);
+    my_assert(own != NULL);
+    my_assert(mem_pool_alloc(starved, 6000) == NULL); // Stealing is off by default
+
+    // The starved pool borrows an extent of the sibling instead of failing
+    my_assert(mem_pool_set_stealing(starved, 8192) == 0);
+    char *borrowed = mem_pool_alloc(starved, 6000);
+    my_assert(borrowed >= rich_start && borrowed < rich_start + 16 * 1024);
+    char *second = mem_pool_alloc(starved, 1500); // Same loan
+    my_assert(second >= rich_start && second < rich_start + 16 * 1024);
+    MemStats stats;
+    mem_pool_get_stats(rich, &stats);
+    my_assert(stats.block_count == 3 && stats.used_bytes >= 8192 + 100);
+
+    // Growing past the loan moves the block and keeps its bytes
+    memset(borrowed, 0x3C, 6000);
+    char *grown = mem_pool_resize(starved, borrowed, 7000);
+    my_assert(grown != NULL && grown != borrowed);
+    for (int i = 0; i < 6000; i++) my_assert(grown[i] == 0x3C);
+
+    // Freeing the last block of a loan hands the extent back
+    mem_pool_free(starved, second);
+    mem_pool_free(starved, grown);
+    mem_pool_get_stats(rich, &stats);
+    my_assert(stats.block_count == 2 && stats.used_bytes < 1024);
+
+    // The lender cannot be destroyed while the borrower's blocks live in its loan
+    char *live = mem_pool_alloc(starved, 6000);
+    my_assert(live >= rich_start && live < rich_start + 16 * 1024);
+    memset(live, 0x5A, 6000);
+    my_assert(mem_pool_destroy(rich) == -1);
+    char *extra = mem_pool_alloc(rich, 100); // The lender stays usable
+    my_assert(extra != NULL);
+    for (int i = 0; i < 6000; i++) my_assert(live[i] == 0x5A);
+    mem_pool_free(rich, extra);
+
+    // Destroying the borrower returns its loans too
+    my_assert(mem_pool_destroy(starved) == 0);
+    mem_pool_get_stats(rich, &stats);
+    my_assert(stats.block_count == 2);
+    my_assert(mem_pool_destroy(rich) == 0);
+    my_assert(mem_pool_destroy(NULL) == -1);
+    mem_get_stats(&stats);
+    my_assert(stats.block_count == 1);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_tlab()
+{
+    printf_yellow("  Testing bump-pointer TLABs with epoch reclamation ---> ");
+    mem_init(1 << 20);
+    MemStats stats;
+    my_assert(mem_tlab_alloc(16) == NULL); // Outside a section
+
+    // Consecutive objects are a pointer bump apart
+    my_assert(mem_tlab_begin() == 0);
+    char *a = mem_tlab_alloc(24);
+    char *b = mem_tlab_alloc(8);
+    my_assert(a && b == a + 32 && ((uintptr_t)a % MEM_TLAB_ALIGN) == 0);
+    char *large = mem_tlab_alloc(MEM_TLAB_SIZE); // Too large for a buffer: gets one of its own
+    my_assert(large && ((uintptr_t)large % MEM_TLAB_ALIGN) == 0 && mem_tlab_alloc(8) == b + 16);
+    for (int i = 0; i < 100; i++) my_assert(mem_tlab_alloc(1000) != NULL); // Spills into a second buffer
+    mem_get_stats(&stats);
+    my_assert(stats.used_bytes > 2 * MEM_TLAB_SIZE);
+
+    // A pinned thread keeps the retired buffers alive
+    mem_epoch_advance();
+    mem_get_stats(&stats);
+    my_assert(stats.used_bytes > 2 * MEM_TLAB_SIZE);
+    mem_tlab_end();
+    my_assert(mem_tlab_alloc(16) == NULL);
+
+    // Once unpinned, the next advance frees everything but the current buffer
+    mem_epoch_advance();
+    mem_get_stats(&stats);
+    my_assert(stats.used_bytes == MEM_TLAB_SIZE + MEM_TLAB_ALIGN - 1);
+
+    // The current buffer is rewound as a whole once its epoch is safe
+    my_assert(mem_tlab_begin() == 0);
+    char *first = mem_tlab_alloc(24);
+    mem_tlab_end();
+    mem_epoch_advance();
+    my_assert(mem_tlab_begin() == 0);
+    my_assert(mem_tlab_alloc(24) == first);
+    mem_tlab_end();
+    mem_deinit();
+
+    // Buffers are aligned even when an odd-sized allocation precedes them
+    mem_init(1 << 20);
+    char *odd = mem_alloc(3);
+    my_assert(odd != NULL && mem_tlab_begin() == 0);
+    char *p = mem_tlab_alloc(8);
+    my_assert(p && ((uintptr_t)p % MEM_TLAB_ALIGN) == 0);
+    large = mem_tlab_alloc(MEM_TLAB_SIZE);
+    my_assert(large && ((uintptr_t)large % MEM_TLAB_ALIGN) == 0);
+    mem_tlab_end();
+    mem_free(odd);
+    mem_epoch_advance(); // Frees the dedicated buffer by its block, not its header
+    mem_get_stats(&stats);
+    my_assert(stats.used_bytes == MEM_TLAB_SIZE + MEM_TLAB_ALIGN - 1);
+
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_shared_pool()
+{
+    printf_yellow("  Testing shared-memory heap across processes ---> ");
+    char name[64];
+    snprintf(name, sizeof(name), "/mm_test_%d", (int)getpid());
+    MemShared *heap = mem_shared_create(name, 64 * 1024);
+    my_assert(heap != NULL);
+    my_assert(mem_shared_create(name, 64 * 1024) == NULL); // Name already taken
+
+    // A second mapping of the same heap sits elsewhere; offsets still agree
+    MemShared *other = mem_shared_attach(name);
+    my_assert(other != NULL);
+    char *msg = mem_shared_alloc(heap, 100);
+    my_assert(msg && ((uintptr_t)msg % 16) == 0);
+    strcpy(msg, "zero-copy");
+    char *seen = mem_shared_ptr(other, mem_shared_offset(heap, msg));
+    my_assert(seen != msg && strcmp(seen, "zero-copy") == 0);
+    mem_shared_free(other, seen);
+    mem_shared_free(heap, msg); // Already freed through the other mapping: ignored
+
+    // A child process allocates and hands the parent an offset through a pipe
+    int fds[2];
+    my_assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        MemShared *child = mem_shared_attach(name);
+        char *block = child ? mem_shared_alloc(child, 4000) : NULL;
+        size_t offset = block ? mem_shared_offset(child, block) : 0;
+        if (block) memset(block, 0x7E, 4000);
+        _exit(write(fds[1], &offset, sizeof(offset)) == sizeof(offset) ? 0 : 1);
+    }
+    size_t offset = 0;
+    my_assert(read(fds[0], &offset, sizeof(offset)) == sizeof(offset) && offset != 0);
+    int status;
+    waitpid(pid, &status, 0);
+    my_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    unsigned char *block = mem_shared_ptr(heap, offset);
+    for (int i = 0; i < 4000; i++) my_assert(block[i] == 0x7E);
+    MemStats stats;
+    mem_shared_get_stats(heap, &stats);
+    my_assert(stats.block_count == 2 && stats.used_bytes >= 4000);
+    mem_shared_free(heap, block);
+    mem_shared_get_stats(other, &stats);
+    my_assert(stats.block_count == 1 && stats.free_bytes == stats.pool_size);
+    close(fds[0]);
+    close(fds[1]);
+
+    mem_shared_detach(other);
+    mem_shared_detach(heap);
+    shm_unlink(name);
+    my_assert(mem_shared_attach(name) == NULL);
+    printf_green("[PASS].\n");
+}
+
+void test_persistent_pool()
+{
+    printf_yellow("  Testing persistent file-backed heap and crash recovery ---> ");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mm_test_%d.heap", (int)getpid());
+    unlink(path);
+    MemShared *heap = mem_open(path, 256 * 1024);
+    my_assert(heap != NULL);
+    my_assert(mem_open(path, 0) == NULL); // Already open
+
+    // A linked list of offsets, found again from the root after reopening
+    size_t head = 0;
+    for (int i = 0; i < 100; i++) {
+        size_t *node = mem_shared_alloc(heap, 2 * sizeof(size_t));
+        my_assert(node != NULL);
+        node[0] = head;
+        node[1] = (size_t)i * 7;
+        head = mem_shared_offset(heap, node);
+    }
+    my_assert(mem_shared_set_root(heap, head) == 0);
+    my_assert(mem_shared_set_root(heap, 1) == -1);
+    my_assert(mem_shared_sync(heap) == 0);
+    mem_shared_detach(heap);
+
+    heap = mem_open(path, 0);
+    my_assert(heap != NULL);
+    int count = 0;
+    for (size_t offset = mem_shared_root(heap); offset; count++) {
+        size_t *node = mem_shared_ptr(heap, offset);
+        my_assert(node[1] == (size_t)(99 - count) * 7);
+        offset = node[0];
+    }
+    my_assert(count == 100);
+    mem_shared_detach(heap);
+
+    // Kill a process mid-stream of allocations; reopening rolls back whatever it left half done
+    for (int round = 0; round < 20; round++) {
+        int fds[2];
+        my_assert(pipe(fds) == 0);
+        pid_t pid = fork();
+        if (pid == 0) {
+            MemShared *child = mem_open(path, 0);
+            char ready = child != NULL;
+            void *live[64] = { 0 };
+            if (write(fds[1], &ready, 1) != 1 || !child) _exit(1);
+            for (unsigned n = (unsigned)round;; n = n * 1103515245u + 12345u) {
+                int slot = (n >> 8) % 64;
+                if (live[slot]) mem_shared_free(child, live[slot]);
+                live[slot] = mem_shared_alloc(child, 16 + (n >> 16) % 2000);
+            }
+        }
+        char ready = 0;
+        my_assert(read(fds[0], &ready, 1) == 1 && ready);
+        usleep(200 + round * 100);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(fds[0]);
+        close(fds[1]);
+
+        heap = mem_open(path, 0);
+        my_assert(heap != NULL);
+        MemStats stats;
+        mem_shared_get_stats(heap, &stats);
+        my_assert(stats.used_bytes + stats.free_bytes == stats.pool_size);
+        void *big = mem_shared_alloc(heap, stats.largest_free_block - 32);
+        my_assert(big != NULL);
+        mem_shared_free(heap, big);
+        mem_shared_detach(heap);
+    }
+
+    // The list survived every crash
+    heap = mem_open(path, 0);
+    count = 0;
+    for (size_t offset = mem_shared_root(heap); offset; count++)
+        offset = ((size_t *)mem_shared_ptr(heap, offset))[0];
+    my_assert(count == 100);
+    mem_shared_detach(heap);
+    unlink(path);
+    printf_green("[PASS].\n");
+}
+
+// Pages of [ptr, ptr + size) that are in RAM
+static size_t resident_pages(void *ptr, size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = (size + page - 1) / page, resident = 0;
+    unsigned char *vec = malloc(pages);
+    my_assert(vec && mincore(ptr, size, vec) == 0);
+    for (size_t i = 0; i < pages; i++) resident += vec[i] & 1;
+    free(vec);
+    return resident;
+}
+
+void test_file_backed_pool()
+{
+    printf_yellow("  Testing out-of-core pool backed by a sparse file ---> ");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mm_pool_%d.data", (int)getpid());
+    MemInitOptions options = { 0, 0, path };
+    size_t size = 64 * 1024 * 1024;
+    unlink(path);
+    my_assert(mem_init_ex(size, &options, NULL) == 0);
+    struct stat st;
+    my_assert(stat(path, &st) == 0 && (size_t)st.st_size == size && st.st_blocks == 0); // Sparse
+
+    // Allocating and freeing never touch pool pages: the metadata lives elsewhere
+    void *blocks[32];
+    for (int i = 0; i < 32; i++) {
+        blocks[i] = mem_alloc(1024 * 1024);
+        my_assert(blocks[i] != NULL);
+    }
+    for (int i = 0; i < 32; i += 2) mem_free(blocks[i]);
+    for (int i = 0; i < 32; i += 2) blocks[i] = mem_alloc(512 * 1024);
+    for (int i = 0; i < 32; i++) my_assert(resident_pages(blocks[i], 512 * 1024) == 0);
+
+    // Data goes to the file; the hints never change it
+    unsigned char *data = blocks[1];
+    for (size_t i = 0; i < 1024 * 1024; i++) data[i] = (unsigned char)(i * 13);
+    my_assert(mem_advise(data, MEM_ADVICE_SEQUENTIAL) == 0);
+    my_assert(mem_advise(data, MEM_ADVICE_WILLNEED) == 0);
+    my_assert(mem_advise(data, MEM_ADVICE_COLD) == 0);
+    my_assert(mem_advise(data, MEM_ADVICE_NORMAL) == 0);
+    my_assert(mem_advise(data, (MemAdvice)42) == -1);
+    my_assert(mem_advise((char *)data + 8, MEM_ADVICE_COLD) == -1); // Not an allocation
+    my_assert(msync(data, 1024 * 1024, MS_SYNC) == 0);
+    my_assert(stat(path, &st) == 0 && (size_t)st.st_blocks * 512 >= 1024 * 1024);
+    for (size_t i = 0; i < 1024 * 1024; i++) my_assert(data[i] == (unsigned char)(i * 13));
+
+    // Trimming punches freed pages out of the file, after which they read as zero
+    mem_free(data);
+    my_assert(mem_trim() >= 1024 * 1024);
+    my_assert(stat(path, &st) == 0 && (size_t)st.st_blocks * 512 < 1024 * 1024);
+    unsigned char *zeroed = mem_calloc(1, 1024 * 1024);
+    my_assert(zeroed != NULL);
+    for (size_t i = 0; i < 1024 * 1024; i++) my_assert(zeroed[i] == 0);
+
+    mem_deinit();
+
+    // A file that already holds data is refused and left as it was
+    my_assert(mem_init_ex(size, &options, NULL) == -1);
+    my_assert(stat(path, &st) == 0 && (size_t)st.st_size == size);
+    unlink(path);
+    options.backing_file = "/nonexistent/dir/pool";
+    my_assert(mem_init_ex(size, &options, NULL) == -1);
+    printf_green("[PASS].\n");
+}
+
 void test_looking_for_out_of_bounds(int size){
   printf("  Testing outofbounds (errors not tracked/detected here) \n");
   if (size<5000) {
@@ -456,6 +1626,31 @@ int main(int argc, char *argv[])
         printf(" 19. test_init, but large memory - Initialize memory system\n");
 	printf(" 20. test_looking_for_out_of_bounds, needs LD_PRELOAD=./libmymalloc.so .Needs argument of size.\n\n");
 	printf(" 21. test_mmap, needs LD_PRELOAD=./libmymalloc.so .\n\n");
+
+	printf("\nPolicies and Statistics:\n");
+	printf(" 22. test_placement_policies - First, next and best fit pick the expected block\n");
+	printf(" 23. test_stats - mem_get_stats reports the pool layout\n");
+	printf(" 24. test_deferred_coalescing - Freed blocks are reused from quick lists and merged in batches\n");
+	printf(" 25. test_handle_compaction - Unpinned handle blocks slide together on mem_compact\n");
+	printf(" 26. test_regions - Nested regions bump-allocate and release in bulk\n");
+	printf(" 27. test_calloc - mem_calloc zeroes memory and tracks known-zero pages\n");
+	printf(" 28. test_usable_size_and_sized_free - mem_usable_size and mem_free_sized\n");
+	printf(" 29. test_fragmentation_policy - Split threshold, alignment and size-class rounding\n");
+	printf(" 30. test_maintenance_thread - Background thread coalesces deferred frees and trims idle pages\n");
+	printf(" 31. test_prefault - mem_init_ex prefaults the pool in parallel and locks it\n");
+	printf(" 32. test_lazy_init - A huge pool is reserved lazily and torn down in one call\n");
+	printf(" 33. test_inline_fast_path - Per-thread size-class caches behind mem_alloc_inline\n");
+	printf(" 34. test_sub_pools - Child pools carved from a parent are destroyed with one free\n");
+	printf(" 35. test_block_table - Free-block search over the struct-of-arrays block table matches the list walk\n");
+	printf(" 36. test_small_blocks - Small requests are served from a bitmap-managed granule region\n");
+	printf(" 37. test_page_bags - Tiny objects live in size-segregated pages and carry no header\n");
+	printf(" 38. test_fixed_pool - Lock-free fixed-size pool survives concurrent push and pop\n");
+	printf(" 39. test_remote_free - Blocks freed by another thread return to the owner's cache\n");
+	printf(" 40. test_pool_stealing - A starved child pool borrows free extents from its siblings\n");
+	printf(" 41. test_tlab - Bump-pointer TLABs are reclaimed whole once the epoch moves on\n");
+	printf(" 42. test_shared_pool - Processes share a heap through an shm_open mapping and offsets\n");
+	printf(" 43. test_persistent_pool - A file-backed heap reopens with its data and recovers from killed processes\n");
+	printf(" 44. test_file_backed_pool - The pool is a sparse file; metadata stays out of it and mem_advise hints its pages\n\n");
 	
         printf(" 0. Run all tests (excluding 20)\n");
         return 1;
@@ -494,6 +1689,31 @@ int main(int argc, char *argv[])
         test_zero_alloc_and_free();
         test_random_blocks();
 	test_init(1048576);
+
+        printf("\nTesting Policies and Statistics:\n");
+        test_placement_policies();
+        test_stats();
+        test_deferred_coalescing();
+        test_handle_compaction();
+        test_regions();
+        test_calloc();
+        test_usable_size_and_sized_free();
+        test_fragmentation_policy();
+        test_maintenance_thread();
+        test_prefault();
+        test_lazy_init();
+        test_inline_fast_path();
+        test_sub_pools();
+        test_block_table();
+        test_small_blocks();
+        test_page_bags();
+        test_fixed_pool();
+        test_remote_free();
+        test_pool_stealing();
+        test_tlab();
+        test_shared_pool();
+        test_persistent_pool();
+        test_file_backed_pool();
         break;
     case 1:
         test_init(1024);
@@ -560,6 +1780,75 @@ int main(int argc, char *argv[])
     case 21:
       test_mmap();
       break;
+    case 22:
+      test_placement_policies();
+      break;
+    case 23:
+      test_stats();
+      break;
+    case 24:
+      test_deferred_coalescing();
+      break;
+    case 25:
+      test_handle_compaction();
+      break;
+    case 26:
+      test_regions();
+      break;
+    case 27:
+      test_calloc();
+      break;
+    case 28:
+      test_usable_size_and_sized_free();
+      break;
+    case 29:
+      test_fragmentation_policy();
+      break;
+    case 30:
+      test_maintenance_thread();
+      break;
+    case 31:
+      test_prefault();
+      break;
+    case 32:
+      test_lazy_init();
+      break;
+    case 33:
+      test_inline_fast_path();
+      break;
+    case 34:
+      test_sub_pools();
+      break;
+    case 35:
+      test_block_table();
+      break;
+    case 36:
+      test_small_blocks();
+      break;
+    case 37:
+      test_page_bags();
+      break;
+    case 38:
+      test_fixed_pool();
+      break;
+    case 39:
+      test_remote_free();
+      break;
+    case 40:
+      test_pool_stealing();
+      break;
+    case 41:
+      test_tlab();
+      break;
+    case 42:
+      test_shared_pool();
+      break;
+    case 43:
+      test_persistent_pool();
+      break;
+    case 44:
+      test_file_backed_pool();
+      break;
     default:
       printf("Invalid test function\n");
       break;